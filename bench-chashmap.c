@@ -0,0 +1,185 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   bench-chashmap.c
+ *  Description: Measures multi-threaded throughput of CHASHMAP against a
+ *  HASHMAP guarded by one global mutex. Every thread mixes lookups over the
+ *  whole key space with inserts and removals of keys in its own range. A
+ *  second table fills an empty CHASHMAP from every thread at once, so that it
+ *  grows throughout, and reports the slowest single insert seen.
+ *  Usage: ./bench-chashmap [max threads] [keys] [ops per thread] [read %]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "chashmap.h"
+#include "hashmap.h"
+#include "integer.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+typedef struct worker {
+    pthread_t thread;
+    int id;
+    int threads;
+    bool concurrent;
+    double worst;       // slowest insert of a fill, in seconds
+} WORKER;
+
+static INTEGER **keys;
+static bool *present;
+static int keyCount;
+static int opsPerThread;
+static int readPercent;
+static CHASHMAP *cmap;
+static HASHMAP *map;
+static pthread_mutex_t mapLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int nextRandom(unsigned int *state) {
+    // xorshift32
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void *work(void *arg) {
+    WORKER *w = arg;
+    unsigned int state = 2463534242u + w->id * 7919u;
+    // writes stay within this thread's slice of the keys
+    int span = keyCount / w->threads;
+    int base = w->id * span;
+    for (int i = 0; i < opsPerThread; ++i) {
+        unsigned int r = nextRandom(&state);
+        if ((int)(r % 100) < readPercent) {
+            INTEGER *key = keys[nextRandom(&state) % keyCount];
+            if (w->concurrent) getCHASHMAPvalue(cmap, key);
+            else {
+                pthread_mutex_lock(&mapLock);
+                getHASHMAPvalue(map, key);
+                pthread_mutex_unlock(&mapLock);
+            }
+            continue;
+        }
+        int k = base + nextRandom(&state) % span;
+        if (w->concurrent) {
+            if (present[k]) removeCHASHMAP(cmap, keys[k]);
+            else insertCHASHMAP(cmap, keys[k], keys[k]);
+        }
+        else {
+            pthread_mutex_lock(&mapLock);
+            if (present[k]) removeHASHMAP(map, keys[k]);
+            else insertHASHMAP(map, keys[k], keys[k]);
+            pthread_mutex_unlock(&mapLock);
+        }
+        present[k] = !present[k];
+    }
+    return NULL;
+}
+
+static void *fill(void *arg) {
+    // inserts this thread's interleaved share of the keys, timing each one
+    WORKER *w = arg;
+    w->worst = 0;
+    for (int k = w->id; k < keyCount; k += w->threads) {
+        double start = now();
+        insertCHASHMAP(cmap, keys[k], keys[k]);
+        double elapsed = now() - start;
+        if (elapsed > w->worst) w->worst = elapsed;
+    }
+    return NULL;
+}
+
+static double runFill(int threads, double *worst) {
+    cmap = newCHASHMAP(prehashINTEGER, compareINTEGER);
+    WORKER *workers = malloc(sizeof(WORKER) * threads);
+    assert(workers != NULL);
+    double start = now();
+    for (int i = 0; i < threads; ++i) {
+        workers[i].id = i;
+        workers[i].threads = threads;
+        workers[i].concurrent = true;
+        pthread_create(&workers[i].thread, NULL, fill, &workers[i]);
+    }
+    *worst = 0;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].worst > *worst) *worst = workers[i].worst;
+    }
+    double elapsed = now() - start;
+    assert(sizeCHASHMAP(cmap) == keyCount);
+    free(workers);
+    freeCHASHMAP(cmap);
+    return keyCount / elapsed / 1e6;
+}
+
+static double run(int threads, bool concurrent) {
+    if (concurrent) cmap = newCHASHMAP(prehashINTEGER, compareINTEGER);
+    else map = newHASHMAP(prehashINTEGER, compareINTEGER);
+    // start with every other key present
+    for (int i = 0; i < keyCount; ++i) {
+        present[i] = (i % 2 == 0);
+        if (!present[i]) continue;
+        if (concurrent) insertCHASHMAP(cmap, keys[i], keys[i]);
+        else insertHASHMAP(map, keys[i], keys[i]);
+    }
+    WORKER *workers = malloc(sizeof(WORKER) * threads);
+    assert(workers != NULL);
+    double start = now();
+    for (int i = 0; i < threads; ++i) {
+        workers[i].id = i;
+        workers[i].threads = threads;
+        workers[i].concurrent = concurrent;
+        pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    double elapsed = now() - start;
+    free(workers);
+    if (concurrent) freeCHASHMAP(cmap);
+    else freeHASHMAP(map);
+    return (double)threads * opsPerThread / elapsed / 1e6;
+}
+
+
+int main(int argc, char **argv) {
+    int maxThreads = (argc > 1) ? atoi(argv[1]) : 32;
+    keyCount = (argc > 2) ? atoi(argv[2]) : 1000000;
+    opsPerThread = (argc > 3) ? atoi(argv[3]) : 1000000;
+    readPercent = (argc > 4) ? atoi(argv[4]) : 90;
+    assert(maxThreads > 0 && keyCount >= maxThreads && opsPerThread > 0);
+    keys = malloc(sizeof(INTEGER *) * keyCount);
+    present = malloc(sizeof(bool) * keyCount);
+    assert(keys != NULL && present != NULL);
+    for (int i = 0; i < keyCount; ++i) keys[i] = newINTEGER(i);
+    printf("%8s %16s %16s\n", "threads", "mutex Mops/s", "chashmap Mops/s");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double locked = run(threads, false);
+        double striped = run(threads, true);
+        printf("%8d %16.2f %16.2f\n", threads, locked, striped);
+    }
+    printf("\n%8s %16s %16s\n", "threads", "fill Mops/s", "worst insert us");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double worst;
+        double filled = runFill(threads, &worst);
+        printf("%8d %16.2f %16.1f\n", threads, filled, worst * 1e6);
+    }
+    for (int i = 0; i < keyCount; ++i) freeINTEGER(keys[i]);
+    free(keys);
+    free(present);
+    return 0;
+}
@@ -0,0 +1,466 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   bench-hashmap.c
+ *  Description: Benchmark harness for the HASHMAP backends. For every
+ *  combination of backend, key type, key distribution and size it times an
+ *  insert phase, a lookup phase, a mixed read/write phase and a remove
+ *  phase, and prints one CSV (or JSON) record per phase with throughput,
+ *  latency percentiles, peak RSS and bytes per entry.
+ *
+ *  Usage: ./bench-hashmap [--option=value ...]
+ *      --backends=chained,pool,linear,swiss    storage strategies to compare
+ *      --keys=int,string,real              key modules to exercise
+ *      --dist=uniform,zipf                 access distributions
+ *      --sizes=1000,100000,1000000         entries loaded into each map
+ *      --hit=1.0,0.5                       share of lookups that find a key
+ *      --read=0.9                          share of reads in the mixed phase
+ *      --ops=1000000                       operations per lookup/mixed phase
+ *      --zipf=0.99                         skew of the Zipfian distribution
+ *      --format=csv|json                   output format
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "hashmap.h"
+#include "integer.h"
+#include "real.h"
+#include "string.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/********** Global Constants **********/
+#define MAX_LIST 16             // values accepted per list option
+#define SAMPLE_EVERY 8          // one operation in SAMPLE_EVERY is timed alone
+#define STRING_KEY_LENGTH 16
+
+
+/********** Option Structs **********/
+
+typedef struct list {
+    int count;
+    char *names[MAX_LIST];
+    double values[MAX_LIST];
+} LIST;
+
+typedef struct options {
+    LIST backends;
+    LIST keys;
+    LIST dists;
+    LIST sizes;
+    LIST hits;
+    LIST reads;
+    long ops;
+    double theta;
+    bool json;
+} OPTIONS;
+
+
+/********** Key Set Struct **********/
+
+// present[i] is loaded into the map, absent[i] never is
+typedef struct keyset {
+    const char *type;
+    long size;
+    void **present;
+    void **absent;
+    char *strings;      // backing characters for STRING keys
+    int (*prehash)(void *);
+    int (*compare)(void *, void *);
+    void (*free)(void *);
+} KEYSET;
+
+
+/********** Zipfian Generator Struct **********/
+
+// Gray et al., "Quickly Generating Billion-Record Synthetic Databases"
+typedef struct zipf {
+    long items;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double half;        // 1 + 0.5^theta
+} ZIPF;
+
+
+/********** Result Struct **********/
+
+typedef struct result {
+    const char *phase;
+    long ops;
+    double seconds;
+    double *samples;
+    long sampleCount;
+    double bytesPerEntry;
+} RESULT;
+
+
+static unsigned long long rngState = 0x9e3779b97f4a7c15ull;
+
+
+/********** Private Function Definitions **********/
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long nextRandom(void) {
+    // splitmix64
+    unsigned long long z = (rngState += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double nextUnit(void) {
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned int scramble(unsigned int x) {
+    // bijective, so distinct indices give distinct keys
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static long residentBytes(void) {
+    // current resident set size from /proc; 0 where unavailable
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static long peakResidentKB(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void parseList(LIST *list, char *text, bool numeric) {
+    list->count = 0;
+    for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ",")) {
+        assert(list->count < MAX_LIST);
+        list->names[list->count] = item;
+        list->values[list->count] = numeric ? atof(item) : 0;
+        list->count++;
+    }
+}
+
+static void parseOptions(OPTIONS *options, int argc, char **argv) {
+    static char defaults[][32] = {
+        "chained,pool,linear,swiss", "int,string,real", "uniform,zipf",
+        "1000,100000,1000000", "1.0,0.5", "0.9"
+    };
+    parseList(&options->backends, defaults[0], false);
+    parseList(&options->keys, defaults[1], false);
+    parseList(&options->dists, defaults[2], false);
+    parseList(&options->sizes, defaults[3], true);
+    parseList(&options->hits, defaults[4], true);
+    parseList(&options->reads, defaults[5], true);
+    options->ops = 1000000;
+    options->theta = 0.99;
+    options->json = false;
+    for (int i = 1; i < argc; ++i) {
+        char *value = strchr(argv[i], '=');
+        if (strncmp(argv[i], "--", 2) != 0 || value == NULL) {
+            fprintf(stderr, "bench-hashmap: bad option %s\n", argv[i]);
+            exit(1);
+        }
+        *value++ = '\0';
+        char *name = argv[i] + 2;
+        if (strcmp(name, "backends") == 0) parseList(&options->backends, value, false);
+        else if (strcmp(name, "keys") == 0) parseList(&options->keys, value, false);
+        else if (strcmp(name, "dist") == 0) parseList(&options->dists, value, false);
+        else if (strcmp(name, "sizes") == 0) parseList(&options->sizes, value, true);
+        else if (strcmp(name, "hit") == 0) parseList(&options->hits, value, true);
+        else if (strcmp(name, "read") == 0) parseList(&options->reads, value, true);
+        else if (strcmp(name, "ops") == 0) options->ops = atol(value);
+        else if (strcmp(name, "zipf") == 0) options->theta = atof(value);
+        else if (strcmp(name, "format") == 0) options->json = strcmp(value, "json") == 0;
+        else {
+            fprintf(stderr, "bench-hashmap: unknown option --%s\n", name);
+            exit(1);
+        }
+    }
+}
+
+static void *makeKey(KEYSET *set, long index, unsigned int id) {
+    if (strcmp(set->type, "int") == 0) return newINTEGER((int)id);
+    if (strcmp(set->type, "real") == 0) return newREAL(id * 1.0000001);
+    char *text = set->strings + index * STRING_KEY_LENGTH;
+    snprintf(text, STRING_KEY_LENGTH, "key:%08x", id);
+    return newSTRING(text);
+}
+
+static void newKeySet(KEYSET *set, const char *type, long size) {
+    set->type = type;
+    set->size = size;
+    set->present = malloc(sizeof(void *) * size);
+    set->absent = malloc(sizeof(void *) * size);
+    assert(set->present != NULL && set->absent != NULL);
+    set->strings = NULL;
+    if (strcmp(type, "int") == 0) {
+        set->prehash = prehashINTEGER;
+        set->compare = compareINTEGER;
+        set->free = freeINTEGER;
+    }
+    else if (strcmp(type, "real") == 0) {
+        set->prehash = prehashREAL;
+        set->compare = compareREAL;
+        set->free = freeREAL;
+    }
+    else if (strcmp(type, "string") == 0) {
+        set->prehash = prehashSTRING;
+        set->compare = compareSTRINGequality;
+        set->free = freeSTRING;
+        set->strings = malloc((size_t)size * 2 * STRING_KEY_LENGTH);
+        assert(set->strings != NULL);
+    }
+    else {
+        fprintf(stderr, "bench-hashmap: unknown key type %s\n", type);
+        exit(1);
+    }
+    for (long i = 0; i < size; ++i) {
+        // even ids are loaded, odd ids are the guaranteed misses
+        set->present[i] = makeKey(set, 2 * i, scramble((unsigned int)i) & ~1u);
+        set->absent[i] = makeKey(set, 2 * i + 1, scramble((unsigned int)i) | 1u);
+    }
+}
+
+static void freeKeySet(KEYSET *set) {
+    for (long i = 0; i < set->size; ++i) {
+        set->free(set->present[i]);
+        set->free(set->absent[i]);
+    }
+    free(set->present);
+    free(set->absent);
+    free(set->strings);
+}
+
+static double zeta(long n, double theta) {
+    double sum = 0;
+    for (long i = 1; i <= n; ++i) sum += 1.0 / pow((double)i, theta);
+    return sum;
+}
+
+static void newZIPF(ZIPF *z, long items, double theta) {
+    z->items = items;
+    z->theta = theta;
+    z->zetan = zeta(items, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta(2, theta) / z->zetan);
+    z->half = 1 + pow(0.5, theta);
+}
+
+static long nextIndex(ZIPF *z, long size) {
+    // uniform when z is NULL; Zipfian ranks are scattered over the key space
+    // so the hottest keys are not neighbours in the key arrays
+    if (z == NULL) return (long)(nextRandom() % (unsigned long long)size);
+    double u = nextUnit();
+    double uz = u * z->zetan;
+    long rank;
+    if (uz < 1.0) rank = 0;
+    else if (uz < z->half) rank = 1;
+    else rank = (long)(z->items * pow(z->eta * u - z->eta + 1, z->alpha));
+    if (rank >= z->items) rank = z->items - 1;
+    return (long)(scramble((unsigned int)rank) % (unsigned long long)size);
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(RESULT *r, double p) {
+    if (r->sampleCount == 0) return 0;
+    long index = (long)(p * (r->sampleCount - 1) + 0.5);
+    return r->samples[index];
+}
+
+static void report(OPTIONS *options, const char *backend, KEYSET *set,
+        const char *dist, double hit, double read, RESULT *r) {
+    qsort(r->samples, r->sampleCount, sizeof(double), compareDoubles);
+    double opsPerSecond = r->ops / r->seconds;
+    if (options->json) {
+        printf("{\"backend\":\"%s\",\"keys\":\"%s\",\"dist\":\"%s\",\"size\":%ld,"
+                "\"phase\":\"%s\",\"hit_ratio\":%.2f,\"read_ratio\":%.2f,\"ops\":%ld,"
+                "\"ops_per_sec\":%.0f,\"ns_p50\":%.1f,\"ns_p90\":%.1f,\"ns_p99\":%.1f,"
+                "\"ns_p999\":%.1f,\"peak_rss_kb\":%ld,\"bytes_per_entry\":%.1f}\n",
+                backend, set->type, dist, set->size, r->phase, hit, read, r->ops,
+                opsPerSecond, percentile(r, 0.5), percentile(r, 0.9),
+                percentile(r, 0.99), percentile(r, 0.999), peakResidentKB(),
+                r->bytesPerEntry);
+    }
+    else {
+        printf("%s,%s,%s,%ld,%s,%.2f,%.2f,%ld,%.0f,%.1f,%.1f,%.1f,%.1f,%ld,%.1f\n",
+                backend, set->type, dist, set->size, r->phase, hit, read, r->ops,
+                opsPerSecond, percentile(r, 0.5), percentile(r, 0.9),
+                percentile(r, 0.99), percentile(r, 0.999), peakResidentKB(),
+                r->bytesPerEntry);
+    }
+    fflush(stdout);
+}
+
+static void startPhase(RESULT *r, const char *phase, long ops) {
+    r->phase = phase;
+    r->ops = ops;
+    r->sampleCount = 0;
+    r->bytesPerEntry = 0;
+}
+
+static HASHMAP *newBenchMap(const char *backend, KEYSET *set) {
+    HASHMAP *map;
+    if (strcmp(backend, "linear") == 0) {
+        map = newHASHMAPbackend(set->prehash, set->compare, HASHMAP_LINEAR_PROBING);
+    }
+    else if (strcmp(backend, "swiss") == 0) {
+        map = newHASHMAPbackend(set->prehash, set->compare, HASHMAP_SWISS);
+    }
+    else if (strcmp(backend, "chained") == 0 || strcmp(backend, "pool") == 0) {
+        map = newHASHMAPbackend(set->prehash, set->compare, HASHMAP_CHAINED);
+        setHASHMAPnodePool(map, strcmp(backend, "pool") == 0);
+    }
+    else {
+        fprintf(stderr, "bench-hashmap: unknown backend %s\n", backend);
+        exit(1);
+    }
+    return map;
+}
+
+static void *pickKey(KEYSET *set, ZIPF *z, double hit) {
+    long i = nextIndex(z, set->size);
+    return (hit >= 1.0 || nextUnit() < hit) ? set->present[i] : set->absent[i];
+}
+
+static void benchmark(OPTIONS *options, const char *backend, KEYSET *set,
+        const char *dist, RESULT *r) {
+    ZIPF zipf, *z = NULL;
+    if (strcmp(dist, "zipf") == 0) {
+        newZIPF(&zipf, set->size, options->theta);
+        z = &zipf;
+    }
+    else if (strcmp(dist, "uniform") != 0) {
+        fprintf(stderr, "bench-hashmap: unknown distribution %s\n", dist);
+        exit(1);
+    }
+    long before = residentBytes();
+    HASHMAP *map = newBenchMap(backend, set);
+
+    // insert: load every present key once, in key order
+    startPhase(r, "insert", set->size);
+    double start = now();
+    for (long i = 0; i < set->size; ++i) {
+        if (i % SAMPLE_EVERY == 0) {
+            double t = now();
+            insertHASHMAP(map, set->present[i], set->present[i]);
+            r->samples[r->sampleCount++] = (now() - t) * 1e9;
+        }
+        else insertHASHMAP(map, set->present[i], set->present[i]);
+    }
+    r->seconds = now() - start;
+    r->bytesPerEntry = (double)(residentBytes() - before) / set->size;
+    report(options, backend, set, dist, 1.0, 0.0, r);
+
+    // lookup: reads only, at each requested hit ratio
+    for (int h = 0; h < options->hits.count; ++h) {
+        double hit = options->hits.values[h];
+        startPhase(r, "lookup", options->ops);
+        start = now();
+        for (long i = 0; i < options->ops; ++i) {
+            void *key = pickKey(set, z, hit);
+            if (i % SAMPLE_EVERY == 0) {
+                double t = now();
+                getHASHMAPvalue(map, key);
+                r->samples[r->sampleCount++] = (now() - t) * 1e9;
+            }
+            else getHASHMAPvalue(map, key);
+        }
+        r->seconds = now() - start;
+        report(options, backend, set, dist, hit, 1.0, r);
+    }
+
+    // mixed: reads at the first hit ratio; a write removes a loaded key and
+    // puts it straight back, so the map size stays fixed
+    for (int m = 0; m < options->reads.count; ++m) {
+        double read = options->reads.values[m];
+        double hit = options->hits.values[0];
+        startPhase(r, "mixed", options->ops);
+        start = now();
+        for (long i = 0; i < options->ops; ++i) {
+            bool isRead = nextUnit() < read;
+            void *key = isRead ? pickKey(set, z, hit) : set->present[nextIndex(z, set->size)];
+            double t = (i % SAMPLE_EVERY == 0) ? now() : 0;
+            if (isRead) getHASHMAPvalue(map, key);
+            else {
+                removeHASHMAP(map, key);
+                insertHASHMAP(map, key, key);
+            }
+            if (i % SAMPLE_EVERY == 0) r->samples[r->sampleCount++] = (now() - t) * 1e9;
+        }
+        r->seconds = now() - start;
+        report(options, backend, set, dist, hit, read, r);
+    }
+
+    // remove: drain every key, in key order
+    startPhase(r, "remove", set->size);
+    start = now();
+    for (long i = 0; i < set->size; ++i) {
+        if (i % SAMPLE_EVERY == 0) {
+            double t = now();
+            removeHASHMAP(map, set->present[i]);
+            r->samples[r->sampleCount++] = (now() - t) * 1e9;
+        }
+        else removeHASHMAP(map, set->present[i]);
+    }
+    r->seconds = now() - start;
+    report(options, backend, set, dist, 1.0, 0.0, r);
+    freeHASHMAP(map);
+}
+
+
+int main(int argc, char **argv) {
+    OPTIONS options;
+    parseOptions(&options, argc, argv);
+    if (options.json == false) {
+        printf("backend,keys,dist,size,phase,hit_ratio,read_ratio,ops,ops_per_sec,"
+                "ns_p50,ns_p90,ns_p99,ns_p999,peak_rss_kb,bytes_per_entry\n");
+    }
+    for (int s = 0; s < options.sizes.count; ++s) {
+        long size = (long)options.sizes.values[s];
+        assert(size > 0);
+        RESULT result;
+        long maxOps = size > options.ops ? size : options.ops;
+        result.samples = malloc(sizeof(double) * (maxOps / SAMPLE_EVERY + 1));
+        assert(result.samples != NULL);
+        for (int k = 0; k < options.keys.count; ++k) {
+            KEYSET set;
+            newKeySet(&set, options.keys.names[k], size);
+            for (int d = 0; d < options.dists.count; ++d) {
+                for (int b = 0; b < options.backends.count; ++b) {
+                    benchmark(&options, options.backends.names[b], &set,
+                            options.dists.names[d], &result);
+                }
+            }
+            freeKeySet(&set);
+        }
+        free(result.samples);
+    }
+    return 0;
+}
@@ -0,0 +1,544 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   chashmap.c
+ *  Description: This is the implementation file for the concurrent hash map.
+ *
+ *  Buckets are intrusive chains published with release stores. Writers take
+ *  the lock of the stripe their hash falls in; readers take no locks at all
+ *  and only announce the reclamation epoch they are running in. Unlinked
+ *  nodes, replaced values and retired tables are parked on per-stripe limbo
+ *  lists and released once the global epoch has moved two steps past the
+ *  epoch they were retired in, at which point no reader can still hold them.
+ *
+ *  Growing migrates one stripe at a time. Buckets are indexed by the top bits
+ *  of the hash and stripes by the top STRIPE_BITS of them, so in every table
+ *  a stripe owns one contiguous range of buckets. Its chains move into the
+ *  larger table under that stripe's lock alone and are published by pointing
+ *  the stripe's home at the new table. A writer first moves its own stripe,
+ *  then claims one more for the resize, and the other stripes keep taking
+ *  writes meanwhile. Readers probe whichever home they loaded, so they are
+ *  never blocked by a resize. Once the last stripe has moved, the old table
+ *  and its node copies are retired like any other unlinked memory.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "chashmap.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/********** Global Constants **********/
+#define INITIAL_CAPACITY 64     // never below STRIPES, see stripeFor
+#define LOAD_FACTOR 0.75
+#define GROWTH_FACTOR 2
+#define STRIPE_BITS 6
+#define STRIPES (1 << STRIPE_BITS)  // writer lock stripes
+#define MAX_THREADS 128         // threads that may use maps at the same time
+#define EPOCHS 3                // limbo generations kept per stripe
+#define ADVANCE_INTERVAL 64     // retirements between epoch advance attempts
+#define CACHE_LINE 64
+#define MIGRATE_STEPS 1         // extra stripes a writer moves while a resize runs
+
+#define load(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+
+/********** Node and Table Structs **********/
+
+typedef struct cnode {
+    void *key;
+    void *value;            // replaced atomically by insertCHASHMAP
+    struct cnode *next;     // published atomically
+    unsigned int hash;
+} CNODE;
+
+typedef struct ctable {
+    int capacity;
+    int shift;              // 32 - log2(capacity), see bucketFor
+    CNODE **buckets;
+} CTABLE;
+
+
+/********** Reclamation Structs **********/
+
+typedef struct limbo {
+    void *object;
+    void (*release)(CHASHMAP *, void *);
+    struct limbo *next;
+} LIMBO;
+
+// Each stripe and reader record sits on its own cache line so that threads
+// working on different stripes do not contend on the same line.
+typedef struct stripe {
+    pthread_mutex_t lock;
+    LIMBO *limbo[EPOCHS];
+    unsigned long limboEpoch[EPOCHS];
+    int retired;
+} __attribute__((aligned(CACHE_LINE))) STRIPE;
+
+typedef struct reader {
+    unsigned long epoch;    // epoch announced on entry, 0 while quiescent
+    int depth;              // nesting of enterCHASHMAP calls
+} __attribute__((aligned(CACHE_LINE))) READER;
+
+
+/********** Concurrent Hash Map Struct **********/
+
+struct CHASHMAP {
+    CTABLE *table;          // the table every stripe lives in between resizes
+    int size;               // updated atomically
+    unsigned long epoch;    // global reclamation epoch, starts at 1
+
+    // resize state; next is the table being migrated into, or NULL
+    pthread_mutex_t resizeLock; // held only to start or finish a resize
+    CTABLE *next;
+    int pending;            // stripes not yet migrated into next
+    int cursor;             // next stripe a helping writer claims
+
+    void (*freeKey)(void *);
+    void (*freeValue)(void *);
+    int (*prehash)(void *);
+    int (*compare)(void *, void *);
+
+    // the table holding each stripe's chains, read by every lookup and
+    // swapped under that stripe's lock
+    CTABLE *homes[STRIPES] __attribute__((aligned(CACHE_LINE)));
+    STRIPE stripes[STRIPES];
+    READER readers[MAX_THREADS];
+};
+
+
+/********** Thread Registry **********/
+
+// Every thread that touches a CHASHMAP claims one reader slot, shared by all
+// maps, and gives it back when the thread exits.
+static int slotOwners[MAX_THREADS];
+static __thread int threadSlot = -1;
+static pthread_key_t slotKey;
+static pthread_once_t slotOnce = PTHREAD_ONCE_INIT;
+
+
+/********** Private Method Prototypes **********/
+static unsigned int hash(CHASHMAP *map, void *key);
+static int stripeFor(unsigned int hash);
+static int bucketFor(CTABLE *table, unsigned int hash);
+static CTABLE *newTable(int capacity);
+static void releaseTable(CHASHMAP *map, void *table);
+static void releaseNode(CHASHMAP *map, void *node);
+static void releaseValue(CHASHMAP *map, void *value);
+static void retire(CHASHMAP *map, STRIPE *stripe, void *object, void (*release)(CHASHMAP *, void *));
+static void freeLimbo(CHASHMAP *map, LIMBO *limbo);
+static void tryAdvance(CHASHMAP *map);
+static void grow(CHASHMAP *map, int capacity);
+static CTABLE *homeFor(CHASHMAP *map, int stripe);
+static void migrate(CHASHMAP *map, int stripe, CTABLE *to);
+static void helpMigrate(CHASHMAP *map);
+static int slot(void);
+static void makeSlotKey(void);
+static void releaseSlot(void *slot);
+
+
+/********** Public Method Definitions **********/
+
+CHASHMAP *newCHASHMAP(int (*prehash)(void *), int (*comparator)(void *, void *)) {
+    CHASHMAP *map;
+    int error = posix_memalign((void **)&map, CACHE_LINE, sizeof(CHASHMAP));
+    assert(error == 0);
+    (void)error;
+    map->table = newTable(INITIAL_CAPACITY);
+    map->size = 0;
+    map->epoch = 1;
+    pthread_mutex_init(&map->resizeLock, NULL);
+    map->next = NULL;
+    map->pending = 0;
+    map->cursor = STRIPES;
+    map->freeKey = NULL;
+    map->freeValue = NULL;
+    map->prehash = prehash;
+    map->compare = comparator;
+    for (int i = 0; i < STRIPES; ++i) {
+        map->homes[i] = map->table;
+        pthread_mutex_init(&map->stripes[i].lock, NULL);
+        for (int j = 0; j < EPOCHS; ++j) {
+            map->stripes[i].limbo[j] = NULL;
+            map->stripes[i].limboEpoch[j] = 0;
+        }
+        map->stripes[i].retired = 0;
+    }
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        map->readers[i].epoch = 0;
+        map->readers[i].depth = 0;
+    }
+    return map;
+}
+
+void setCHASHMAPfreeKey(CHASHMAP *map, void (*free)(void *)) {
+    assert(map != NULL);
+    map->freeKey = free;
+}
+
+void setCHASHMAPfreeValue(CHASHMAP *map, void (*free)(void *)) {
+    assert(map != NULL);
+    map->freeValue = free;
+}
+
+void insertCHASHMAP(CHASHMAP *map, void *key, void *value) {
+    // Inserts key, or replaces the value of an existing equal key. In that
+    // case the map keeps its own key and frees the one passed in.
+    assert(map != NULL);
+    assert(key != NULL);
+    unsigned int h = hash(map, key);
+    STRIPE *stripe = &map->stripes[stripeFor(h)];
+    pthread_mutex_lock(&stripe->lock);
+    // the stripe's home cannot change while its lock is held
+    CTABLE *table = homeFor(map, stripeFor(h));
+    CNODE **bucket = &table->buckets[bucketFor(table, h)];
+    for (CNODE *node = *bucket; node != NULL; node = node->next) {
+        if (node->hash == h && map->compare(node->key, key) == 0) {
+            void *old = node->value;
+            store(&node->value, value);
+            if (old != NULL && map->freeValue != NULL) {
+                retire(map, stripe, old, releaseValue);
+            }
+            pthread_mutex_unlock(&stripe->lock);
+            if (map->freeKey != NULL) map->freeKey(key);
+            helpMigrate(map);
+            return;
+        }
+    }
+    CNODE *node = malloc(sizeof(CNODE));
+    assert(node != NULL);
+    node->key = key;
+    node->value = value;
+    node->hash = h;
+    node->next = *bucket;
+    // publish the fully initialised node to concurrent readers
+    store(bucket, node);
+    int size = __atomic_add_fetch(&map->size, 1, __ATOMIC_RELAXED);
+    int capacity = table->capacity;
+    pthread_mutex_unlock(&stripe->lock);
+    if (size > capacity * LOAD_FACTOR) {
+        grow(map, capacity * GROWTH_FACTOR);
+    }
+    helpMigrate(map);
+}
+
+bool removeCHASHMAP(CHASHMAP *map, void *key) {
+    // Unlinks key and retires its node; the key and value are freed with the
+    // map's callbacks once no reader can still reach them.
+    assert(map != NULL);
+    assert(key != NULL);
+    unsigned int h = hash(map, key);
+    STRIPE *stripe = &map->stripes[stripeFor(h)];
+    pthread_mutex_lock(&stripe->lock);
+    CTABLE *table = homeFor(map, stripeFor(h));
+    CNODE **link = &table->buckets[bucketFor(table, h)];
+    for (; *link != NULL; link = &(*link)->next) {
+        CNODE *node = *link;
+        if (node->hash == h && map->compare(node->key, key) == 0) {
+            __atomic_store_n(link, node->next, __ATOMIC_SEQ_CST);
+            __atomic_sub_fetch(&map->size, 1, __ATOMIC_RELAXED);
+            retire(map, stripe, node, releaseNode);
+            pthread_mutex_unlock(&stripe->lock);
+            helpMigrate(map);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    helpMigrate(map);
+    return false;
+}
+
+void *getCHASHMAPvalue(CHASHMAP *map, void *key) {
+    // Wait-free lookup. The returned value stays valid until it is replaced
+    // or removed, or for as long as the caller stays inside enterCHASHMAP.
+    assert(map != NULL);
+    assert(key != NULL);
+    unsigned int h = hash(map, key);
+    void *value = NULL;
+    enterCHASHMAP(map);
+    CTABLE *table = load(&map->homes[stripeFor(h)]);
+    CNODE *node = load(&table->buckets[bucketFor(table, h)]);
+    for (; node != NULL; node = load(&node->next)) {
+        if (node->hash == h && map->compare(node->key, key) == 0) {
+            value = load(&node->value);
+            break;
+        }
+    }
+    exitCHASHMAP(map);
+    return value;
+}
+
+bool containsCHASHMAPkey(CHASHMAP *map, void *key) {
+    assert(map != NULL);
+    assert(key != NULL);
+    unsigned int h = hash(map, key);
+    bool found = false;
+    enterCHASHMAP(map);
+    CTABLE *table = load(&map->homes[stripeFor(h)]);
+    CNODE *node = load(&table->buckets[bucketFor(table, h)]);
+    for (; node != NULL && !found; node = load(&node->next)) {
+        found = node->hash == h && map->compare(node->key, key) == 0;
+    }
+    exitCHASHMAP(map);
+    return found;
+}
+
+void enterCHASHMAP(CHASHMAP *map) {
+    // Opens a read-side critical section. Memory reached inside it is not
+    // reclaimed before the matching exitCHASHMAP. Sections may nest.
+    assert(map != NULL);
+    READER *reader = &map->readers[slot()];
+    if (reader->depth++ == 0) {
+        __atomic_store_n(&reader->epoch, load(&map->epoch), __ATOMIC_RELAXED);
+        // the announcement must be visible before any shared pointer is read
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void exitCHASHMAP(CHASHMAP *map) {
+    assert(map != NULL);
+    READER *reader = &map->readers[slot()];
+    assert(reader->depth > 0);
+    if (--reader->depth == 0) {
+        store(&reader->epoch, 0);
+    }
+}
+
+int sizeCHASHMAP(CHASHMAP *map) {
+    assert(map != NULL);
+    return __atomic_load_n(&map->size, __ATOMIC_RELAXED);
+}
+
+void freeCHASHMAP(CHASHMAP *map) {
+    // Must not race with any other use of the map.
+    assert(map != NULL);
+    // finish an interrupted resize, so that one table holds every chain
+    for (int i = 0; map->next != NULL && i < STRIPES; ++i) {
+        if (map->homes[i] != map->next) migrate(map, i, map->next);
+    }
+    for (int i = 0; i < STRIPES; ++i) {
+        for (int j = 0; j < EPOCHS; ++j) {
+            freeLimbo(map, map->stripes[i].limbo[j]);
+        }
+        pthread_mutex_destroy(&map->stripes[i].lock);
+    }
+    pthread_mutex_destroy(&map->resizeLock);
+    CTABLE *table = map->table;
+    for (int i = 0; i < table->capacity; ++i) {
+        CNODE *node = table->buckets[i];
+        while (node != NULL) {
+            CNODE *next = node->next;
+            releaseNode(map, node);
+            node = next;
+        }
+    }
+    free(table->buckets);
+    free(table);
+    free(map);
+}
+
+
+/********** Private Method Definitions **********/
+
+static unsigned int hash(CHASHMAP *map, void *key) {
+    // murmur3 finalizer, as in hashmap.c
+    unsigned int h = (unsigned int)map->prehash(key);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static int stripeFor(unsigned int hash) {
+    // Capacities never drop below STRIPES, so every bucket belongs to exactly
+    // one stripe in every table and a stripe lock guards whole chains.
+    return hash >> (32 - STRIPE_BITS);
+}
+
+static int bucketFor(CTABLE *table, unsigned int hash) {
+    // the top bits, so that a stripe's buckets are contiguous and each one
+    // splits into two neighbours when the table doubles
+    return hash >> table->shift;
+}
+
+static CTABLE *newTable(int capacity) {
+    assert(capacity >= STRIPES && (capacity & (capacity - 1)) == 0);
+    CTABLE *table = malloc(sizeof(CTABLE));
+    assert(table != NULL);
+    table->capacity = capacity;
+    table->shift = 32;
+    for (int c = capacity; c > 1; c >>= 1) table->shift--;
+    table->buckets = calloc(capacity, sizeof(CNODE *));
+    assert(table->buckets != NULL);
+    return table;
+}
+
+static void releaseTable(CHASHMAP *map, void *table) {
+    // Frees a replaced table and its node copies; keys and values live on in
+    // the table that replaced it.
+    (void)map;
+    CTABLE *old = table;
+    for (int i = 0; i < old->capacity; ++i) {
+        CNODE *node = old->buckets[i];
+        while (node != NULL) {
+            CNODE *next = node->next;
+            free(node);
+            node = next;
+        }
+    }
+    free(old->buckets);
+    free(old);
+}
+
+static void releaseNode(CHASHMAP *map, void *node) {
+    CNODE *n = node;
+    if (map->freeKey != NULL) map->freeKey(n->key);
+    if (n->value != NULL && map->freeValue != NULL) map->freeValue(n->value);
+    free(n);
+}
+
+static void releaseValue(CHASHMAP *map, void *value) {
+    map->freeValue(value);
+}
+
+static void retire(CHASHMAP *map, STRIPE *stripe, void *object, void (*release)(CHASHMAP *, void *)) {
+    // Parks object on the stripe's limbo list for the current epoch. Called
+    // with the stripe lock held, after object has been unlinked.
+    unsigned long epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+    // generations retired two or more epochs ago are unreachable now
+    for (int i = 0; i < EPOCHS; ++i) {
+        if (stripe->limbo[i] != NULL && stripe->limboEpoch[i] + 2 <= epoch) {
+            freeLimbo(map, stripe->limbo[i]);
+            stripe->limbo[i] = NULL;
+        }
+    }
+    int current = epoch % EPOCHS;
+    stripe->limboEpoch[current] = epoch;
+    LIMBO *limbo = malloc(sizeof(LIMBO));
+    assert(limbo != NULL);
+    limbo->object = object;
+    limbo->release = release;
+    limbo->next = stripe->limbo[current];
+    stripe->limbo[current] = limbo;
+    if (++stripe->retired % ADVANCE_INTERVAL == 0) tryAdvance(map);
+}
+
+static void freeLimbo(CHASHMAP *map, LIMBO *limbo) {
+    while (limbo != NULL) {
+        LIMBO *next = limbo->next;
+        limbo->release(map, limbo->object);
+        free(limbo);
+        limbo = next;
+    }
+}
+
+static void tryAdvance(CHASHMAP *map) {
+    // The epoch may only move on once every active reader has observed it.
+    unsigned long epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        unsigned long seen = __atomic_load_n(&map->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (seen != 0 && seen != epoch) return;
+    }
+    __atomic_compare_exchange_n(&map->epoch, &epoch, epoch + 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static void grow(CHASHMAP *map, int capacity) {
+    // Starts migrating into a table of the given capacity, unless a resize
+    // is already running or another writer has grown the table meanwhile.
+    // The stripes are moved by the writers that use them and by helpMigrate.
+    pthread_mutex_lock(&map->resizeLock);
+    if (map->next == NULL && map->table->capacity < capacity) {
+        map->pending = STRIPES;
+        store(&map->next, newTable(capacity));
+        // reset only once next is visible, so a writer that claims a stripe
+        // from the new round also sees the table to move it into
+        store(&map->cursor, 0);
+    }
+    pthread_mutex_unlock(&map->resizeLock);
+}
+
+static CTABLE *homeFor(CHASHMAP *map, int stripe) {
+    // Returns the table holding the stripe's chains, first moving them into
+    // the table being grown into if a resize is running. Called with the
+    // stripe's lock held.
+    CTABLE *next = load(&map->next);
+    if (next != NULL && map->homes[stripe] != next) migrate(map, stripe, next);
+    return map->homes[stripe];
+}
+
+static void migrate(CHASHMAP *map, int stripe, CTABLE *to) {
+    // Copies the stripe's chains into to and makes it the stripe's home.
+    // Readers may still be walking the old chains, so the nodes are copied
+    // and the old ones left intact until the whole old table is retired.
+    // Called with the stripe's lock held.
+    CTABLE *from = map->homes[stripe];
+    int range = from->capacity / STRIPES;
+    for (int i = stripe * range; i < (stripe + 1) * range; ++i) {
+        for (CNODE *node = from->buckets[i]; node != NULL; node = node->next) {
+            CNODE *copy = malloc(sizeof(CNODE));
+            assert(copy != NULL);
+            *copy = *node;
+            CNODE **bucket = &to->buckets[bucketFor(to, node->hash)];
+            copy->next = *bucket;
+            *bucket = copy;
+        }
+    }
+    // publish the finished chains to concurrent readers
+    store(&map->homes[stripe], to);
+    if (__atomic_sub_fetch(&map->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        // every stripe has moved, so nothing reaches the old table but
+        // readers that loaded it earlier
+        pthread_mutex_lock(&map->resizeLock);
+        map->table = to;
+        store(&map->next, NULL);
+        pthread_mutex_unlock(&map->resizeLock);
+        retire(map, &map->stripes[stripe], from, releaseTable);
+    }
+}
+
+static void helpMigrate(CHASHMAP *map) {
+    // Moves up to MIGRATE_STEPS stripes of a running resize, so that it
+    // finishes even if some stripes see no writes. Called without any
+    // stripe lock held, since it takes the lock of the stripe it claims.
+    for (int step = 0; step < MIGRATE_STEPS && load(&map->next) != NULL; ++step) {
+        int stripe = __atomic_fetch_add(&map->cursor, 1, __ATOMIC_ACQ_REL);
+        if (stripe >= STRIPES) return;
+        pthread_mutex_lock(&map->stripes[stripe].lock);
+        homeFor(map, stripe);
+        pthread_mutex_unlock(&map->stripes[stripe].lock);
+    }
+}
+
+static int slot(void) {
+    // Returns the calling thread's reader slot, claiming one on first use.
+    if (threadSlot >= 0) return threadSlot;
+    pthread_once(&slotOnce, makeSlotKey);
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&slotOwners[i], &expected, 1, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            threadSlot = i;
+            pthread_setspecific(slotKey, (void *)(intptr_t)(i + 1));
+            return i;
+        }
+    }
+    assert(!"more than MAX_THREADS threads are using CHASHMAPs");
+    abort();
+}
+
+static void makeSlotKey(void) {
+    pthread_key_create(&slotKey, releaseSlot);
+}
+
+static void releaseSlot(void *slot) {
+    __atomic_store_n(&slotOwners[(intptr_t)slot - 1], 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,28 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   chashmap.h
+ *  Description: This is the public interface for the concurrent hash map.
+ *  Writers serialise per lock stripe, readers never block, and memory
+ *  unlinked by writers is reclaimed once no reader can still observe it.
+ */
+
+#ifndef __CHASHMAP_INCLUDED__
+#define __CHASHMAP_INCLUDED__
+
+#include <stdbool.h>
+
+typedef struct CHASHMAP CHASHMAP;
+
+extern CHASHMAP *newCHASHMAP(int (*prehash)(void *), int (*comparator)(void *, void *));
+extern void      setCHASHMAPfreeKey(CHASHMAP *map, void (*free)(void *));
+extern void      setCHASHMAPfreeValue(CHASHMAP *map, void (*free)(void *));
+extern void      insertCHASHMAP(CHASHMAP *map, void *key, void *value);
+extern bool      removeCHASHMAP(CHASHMAP *map, void *key);
+extern void     *getCHASHMAPvalue(CHASHMAP *map, void *key);
+extern bool      containsCHASHMAPkey(CHASHMAP *map, void *key);
+extern void      enterCHASHMAP(CHASHMAP *map);
+extern void      exitCHASHMAP(CHASHMAP *map);
+extern int       sizeCHASHMAP(CHASHMAP *map);
+extern void      freeCHASHMAP(CHASHMAP *map);
+
+#endif // !__CHASHMAP_INCLUDED__
@@ -1,6 +1,7 @@
 #include "da.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define GROWTH_FACTOR 2
 #define MIN_SIZE_CAPACITY_RATIO 0.25
@@ -9,9 +10,12 @@
 
 /********** Dynamic Array Struct **********/
 
+// The values sit in a ring: element i is stored at store[(front + i) % capacity],
+// so both ends can be added to or removed from without shifting
 struct DA {
     int capacity;
     int size;
+    int front;      // store index of element 0
     void **store;
     int debugLevel;
 
@@ -21,12 +25,14 @@ struct DA {
 
 
 /********** Private Method Prototypes **********/
+static int slot(DA *items, int index);
 static void grow(DA *items);
 static void shrink(DA *items);
+static void resizeStore(DA *items, int newCapacity);
+static void copyOut(DA *items, void **destination);
 static void addToFront(DA *items, void *value);
 static void addToBack(DA *items, void *value);
 static void addBetweenFrontAndBack(DA *items, int index, void *value);
-static void shiftValuesRightOfIndex(DA *items, int index);
 static void *removeFromFront(DA *items);
 static void *removeFromBack(DA *items);
 static void *removeBetweenFrontAndBack(DA *items, int index);
@@ -39,13 +45,28 @@ DA *newDA(void) {
     assert(da != NULL);
     da->capacity = 1;
     da->size = 0;
-    da->store = malloc(sizeof(void **));
+    da->front = 0;
+    da->store = malloc(sizeof(void *));
+    assert(da->store != NULL);
     da->debugLevel = 0;
     da->display = NULL;
     da->free = NULL;
     return da;
 }
 
+DA *newDAfilled(int count, void *value) {
+    // Creates an array holding count copies of value, in a store of exactly
+    // that size.
+    assert(count >= 0);
+    DA *da = newDA();
+    reserveDA(da, count);
+    for (int i = 0; i < count; ++i) {
+        da->store[i] = value;
+    }
+    da->size = count;
+    return da;
+}
+
 void setDAdisplay(DA *items, void (*display)(void *, FILE *)) {
     assert(items != NULL);
     items->display = display;
@@ -59,6 +80,7 @@ void setDAfree(DA *items, void (*free)(void *)) {
 void insertDA(DA *items, int index, void *value) {
     assert(items != NULL);
     assert(index >= 0);
+    assert(index <= items->size);
 
     // if the store is full, grow the store
     if (items->size == items->capacity) {
@@ -85,12 +107,14 @@ void insertDA(DA *items, int index, void *value) {
 void *removeDA(DA *items, int index) {
     assert(items != NULL);
     assert(items->size > 0);
+    assert(index >= 0);
+    assert(index < items->size);
     void *oldValue;
     if (index == ARRAY_FRONT) {
         // remove from front of array
         oldValue = removeFromFront(items);
     }
-    else if (index == items->size) {
+    else if (index == items->size - 1) {
         // remove from back of array
         oldValue = removeFromBack(items);
     }
@@ -100,26 +124,62 @@ void *removeDA(DA *items, int index) {
     }
     items->size--;
     // shrink if necessary
-    if ((double)items->size / (double)items->capacity < MIN_SIZE_CAPACITY_RATIO) {
+    if (items->capacity > 1
+            && (double)items->size / (double)items->capacity < MIN_SIZE_CAPACITY_RATIO) {
         shrink(items);
     }
     // return removed value
     return oldValue;
 }
 
+void appendDA(DA *items, void **values, int count) {
+    // Adds count values to the back of the array, growing the store at most
+    // once and copying them in one or two blocks.
+    assert(items != NULL);
+    assert(count >= 0);
+    assert(values != NULL || count == 0);
+    if (count == 0) return;
+    if (items->size + count > items->capacity) {
+        int newCapacity = items->capacity;
+        while (newCapacity < items->size + count) newCapacity *= GROWTH_FACTOR;
+        resizeStore(items, newCapacity);
+    }
+    int back = slot(items, items->size);
+    // the free space may wrap around the end of the store
+    int first = count < items->capacity - back ? count : items->capacity - back;
+    memcpy(items->store + back, values, sizeof(void *) * first);
+    memcpy(items->store, values + first, sizeof(void *) * (count - first));
+    items->size += count;
+}
+
+void reserveDA(DA *items, int capacity) {
+    // Makes room for capacity values, so that adding up to that many does
+    // not grow the store. The store is never made smaller here.
+    assert(items != NULL);
+    assert(capacity >= 0);
+    if (capacity > items->capacity) resizeStore(items, capacity);
+}
+
 void unionDA(DA *recipient, DA *donor) {
+    // Moves every value of donor to the back of recipient, leaving donor
+    // empty. The donor's store is copied in its one or two ring segments.
     assert(recipient != NULL);
     assert(donor != NULL);
-    for (int i = ARRAY_FRONT; i < donor->size; ++i) {
-        insertDA(recipient, recipient->size, removeDA(donor, ARRAY_FRONT));
-    }
+    assert(recipient != donor);
+    int first = donor->size < donor->capacity - donor->front
+            ? donor->size : donor->capacity - donor->front;
+    reserveDA(recipient, recipient->size + donor->size);
+    appendDA(recipient, donor->store + donor->front, first);
+    appendDA(recipient, donor->store, donor->size - first);
+    donor->size = 0;
+    resizeStore(donor, 1);
 }
 
 void *getDA(DA *items, int index) {
     assert(items != NULL);
     assert(index >= 0);
     assert(index < items->size);
-    return items->store[index];
+    return items->store[slot(items, index)];
 }
 
 void *setDA(DA *items, int index, void *value) {
@@ -130,8 +190,8 @@ void *setDA(DA *items, int index, void *value) {
     // if index is less than the current size of the array
     // save the old value to return later and set the new value
     if (index < items->size) {
-        oldValue = items->store[index];
-        items->store[index] = value;
+        oldValue = items->store[slot(items, index)];
+        items->store[slot(items, index)] = value;
     }
     // else add the new value to the back of the array
     else {
@@ -150,13 +210,14 @@ void displayDA(DA *items, FILE *fp) {
     assert(items != NULL);
     fprintf(fp, "[");
     for (int i = 0; i < items->size; ++i) {
+        void *value = items->store[slot(items, i)];
         // if no display function was provided, print the address
         if (items->display == NULL) {
-            fprintf(fp, "%p", items->store[i]);
+            fprintf(fp, "%p", value);
         }
         // else use the provided display function to print the object
         else {
-            items->display(items->store[i], fp);
+            items->display(value, fp);
         }
         // if index is less than the size of the array
         if (i < items->size - 1) {
@@ -182,16 +243,14 @@ int debugDA(DA *items, int level) {
 
 void shrinkToFitDA(DA *items) {
     assert(items != NULL);
-    int newCapacity = items->size;
-    items->store = realloc(items->store, sizeof(void *) * newCapacity);
-    items->capacity = newCapacity;
+    resizeStore(items, items->size == 0 ? 1 : items->size);
 }
 
 void freeDA(DA *items) {
     assert(items != NULL);
     if (items->free != NULL) {
         for (int i = 0; i < items->size; ++i) {
-            items->free(items->store[i]);
+            items->free(items->store[slot(items, i)]);
         }
     }
     free(items->store);
@@ -201,36 +260,54 @@ void freeDA(DA *items) {
 
 /********** Private Method Definitions **********/
 
+static int slot(DA *items, int index) {
+    // store index of element index, which may also be one past the back
+    int position = items->front + index;
+    return position < items->capacity ? position : position - items->capacity;
+}
+
 static void grow(DA *items) {
     assert(items != NULL);
-    // Calculate new capacity
-    int newCapacity = items->capacity * GROWTH_FACTOR;
-    // realloc store
-    items->store = realloc(items->store, sizeof(void *) * newCapacity);
-    // Update the capacity
-    items->capacity = newCapacity;
+    resizeStore(items, items->capacity * GROWTH_FACTOR);
 }
 
 static void shrink(DA *items) {
     assert(items != NULL);
-    // Calculate new capacity
-    int newCapacity = (items->size == 0) ? 1 : items->capacity / GROWTH_FACTOR;
-    // realloc store
-    items->store = realloc(items->store, sizeof(void *) * newCapacity);
-    // Update capacity
+    resizeStore(items, (items->size == 0) ? 1 : items->capacity / GROWTH_FACTOR);
+}
+
+static void resizeStore(DA *items, int newCapacity) {
+    // Moves the values to the start of a store of newCapacity slots.
+    assert(items != NULL);
+    assert(newCapacity >= items->size && newCapacity > 0);
+    void **store = malloc(sizeof(void *) * newCapacity);
+    assert(store != NULL);
+    copyOut(items, store);
+    free(items->store);
+    items->store = store;
     items->capacity = newCapacity;
+    items->front = 0;
+}
+
+static void copyOut(DA *items, void **destination) {
+    // copies the values in order, as the one or two runs the ring holds
+    int first = items->size < items->capacity - items->front
+            ? items->size : items->capacity - items->front;
+    memcpy(destination, items->store + items->front, sizeof(void *) * first);
+    memcpy(destination + first, items->store, sizeof(void *) * (items->size - first));
 }
 
 static void addToFront(DA *items, void *value) {
     assert(items != NULL);
-    shiftValuesRightOfIndex(items, ARRAY_FRONT);
-    items->store[ARRAY_FRONT] = value;
+    assert(items->size < items->capacity);
+    items->front = (items->front == 0) ? items->capacity - 1 : items->front - 1;
+    items->store[items->front] = value;
 }
 
 static void addToBack(DA *items, void *value) {
     assert(items != NULL);
     assert(items->size < items->capacity);
-    items->store[items->size] = value;
+    items->store[slot(items, items->size)] = value;
 }
 
 static void addBetweenFrontAndBack(DA *items, int index, void *value) {
@@ -239,27 +316,30 @@ static void addBetweenFrontAndBack(DA *items, int index, void *value) {
     assert(items->size < items->capacity);
     assert(index > 0);
     assert(index < items->size);
-    shiftValuesRightOfIndex(items, index);
-    items->store[index] = value;
-}
-
-static void shiftValuesRightOfIndex(DA *items, int index) {
-    assert(items != NULL);
-    assert(index >= 0);
-    for (int i = items->size - 1; i >= index; --i) {
-        items->store[i + 1] = items->store[i];
+    if (index < items->size / 2) {
+        // shift the values left of index one slot towards the front
+        items->front = (items->front == 0) ? items->capacity - 1 : items->front - 1;
+        for (int i = 0; i < index; ++i) {
+            items->store[slot(items, i)] = items->store[slot(items, i + 1)];
+        }
     }
+    else {
+        // shift the values right of index one slot towards the back
+        for (int i = items->size - 1; i >= index; --i) {
+            items->store[slot(items, i + 1)] = items->store[slot(items, i)];
+        }
+    }
+    items->store[slot(items, index)] = value;
 }
 
 static void *removeFromFront(DA *items) {
     assert(items != NULL);
     assert(items->size > 0);
     // get return value
-    void *oldValue = items->store[ARRAY_FRONT];
-    // shift values to the right
-    for (int i = 0; i < items->size; ++i) {
-        items->store[i] = items->store[i + 1];
-    }
+    void *oldValue = items->store[items->front];
+    // the next value becomes the front
+    items->store[items->front] = NULL;
+    items->front = slot(items, 1);
     // return old value
     return oldValue;
 }
@@ -267,10 +347,11 @@ static void *removeFromFront(DA *items) {
 static void *removeFromBack(DA *items) {
     assert(items != NULL);
     assert(items->size > 0);
+    int back = slot(items, items->size - 1);
     // get return value
-    void *oldValue = items->store[items->size];
+    void *oldValue = items->store[back];
     // remove value from back
-    items->store[items->size] = NULL;
+    items->store[back] = NULL;
     // return old value
     return oldValue;
 }
@@ -281,10 +362,19 @@ static void *removeBetweenFrontAndBack(DA *items, int index) {
     assert(index > 0);
     assert(index < items->size);
     // get return value
-    void *oldValue = items->store[index];
-    // shift values to left
-    for (int i = index; i < items->size - 1; ++i) {
-        items->store[i] = items->store[i + 1];
+    void *oldValue = items->store[slot(items, index)];
+    if (index < items->size / 2) {
+        // shift the values left of index one slot towards the back
+        for (int i = index; i > 0; --i) {
+            items->store[slot(items, i)] = items->store[slot(items, i - 1)];
+        }
+        items->front = slot(items, 1);
+    }
+    else {
+        // shift the values right of index one slot towards the front
+        for (int i = index; i < items->size - 1; ++i) {
+            items->store[slot(items, i)] = items->store[slot(items, i + 1)];
+        }
     }
     // return old value
     return oldValue;
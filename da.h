@@ -6,10 +6,13 @@
 typedef struct DA DA;
 
 extern DA   *newDA(void);
+extern DA   *newDAfilled(int count, void *value);
 extern void  setDAdisplay(DA *items, void (*display)(void *, FILE *));
 extern void  setDAfree(DA *items, void (*free)(void *));
 extern void  insertDA(DA *items, int index, void *value);
 extern void *removeDA(DA *items, int index);
+extern void  appendDA(DA *items, void **values, int count);
+extern void  reserveDA(DA *items, int capacity);
 extern void  unionDA(DA *recipient, DA *donor);
 extern void *getDA(DA *items, int index);
 extern void *setDA(DA *items, int index, void *value);
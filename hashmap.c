@@ -5,129 +5,579 @@
  */
 
 
-#include "da.h"
+#define _POSIX_C_SOURCE 200112L
+
 #include "hashmap.h"
-#include "sll.h"
+#include "slab.h"
+#include "threadpool.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// building with -DHASHMAP_NO_SIMD forces the portable HASHMAP_SWISS group match
+#if defined(__SSE2__) && !defined(HASHMAP_NO_SIMD)
+#define HASHMAP_SSE2
+#include <emmintrin.h>
+#endif
 
 
 /********** Global Constants **********/
 #define INITIAL_CAPACITY 16
 #define DEFAULT_LOAD_FACTOR 0.75f
+#define MAX_OPEN_LOAD_FACTOR 0.9 // open addressing needs empty slots to end probes
+#define GROWTH_FACTOR 2
+#define SHRINK_RATIO 0.25       // shrink once size drops below this share of the threshold
+#define REHASH_STEPS 4          // buckets migrated per operation during a rehash
+#define REPORT_BUCKETS 8        // occupancy rows shown by the distribution report
+#define BATCH_WINDOW 16         // keys hashed and prefetched ahead of their probes
+#define PREFETCH_STAGES 3       // dependent loads a batch prefetches per key
+#define GROUP_WIDTH 16          // control bytes matched at once by HASHMAP_SWISS
+#define CTRL_EMPTY 0x80         // control byte of a never-used slot
+#define CTRL_DELETED 0xFE       // control byte of a tombstone
+#define PARALLEL_GRAIN 4096     // slots or keys below which a parallel job stays serial
+#define SNAPSHOT_MAGIC "HMAPSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u // reads back differently on a foreign byte order
+#define SNAPSHOT_ALIGNMENT 8    // every section and encoded item starts on this boundary
+#define PROBE_BUFFER 256        // encoded probe keys up to this size stay on the stack
+#define DUMP_MAGIC "HMAPDUMP"
+#define DUMP_VERSION 1
+#define DUMP_BLOCK 65536        // payload bytes gathered before a block is written
+#define DUMP_MAX_BLOCK (1 << 30)    // larger blocks are taken as corruption
+#define DUMP_NULL_VALUE UINT32_MAX  // value length recorded for a NULL value
+#define RESTORE_DEPTH 2         // decoded blocks the reader may run ahead of the inserter
 
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
 
-/********** Hash Map Struct **********/
+#if defined(__GNUC__)
+#define UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#else
+#define UNLIKELY(condition) (condition)
+#endif
+
+// Reports an operation to the map's trace callback. Without one the cost is
+// a single branch, and the arguments are not evaluated.
+#define TRACE(map, event, key, hash, found) \
+    do { \
+        if (UNLIKELY((map)->trace != NULL)) traceEvent(map, event, key, hash, found); \
+    } while (0)
 
+// building with -DHASHMAP_NO_STATS compiles out the counters and timers
+// reported by statsHASHMAP
+#if defined(HASHMAP_NO_STATS)
+#define COUNT(map, counter) ((void)0)
+#define COUNT_MANY(map, counter, n) ((void)0)
+#define START_TIMER(start) ((void)0)
+#define STOP_TIMER(map, counter, start) ((void)0)
+#else
+#define COUNT(map, counter) ((void)(map)->stats.counter++)
+#define COUNT_MANY(map, counter, n) ((void)((map)->stats.counter += (n)))
+#define START_TIMER(start) double start = seconds()
+#define STOP_TIMER(map, counter, start) ((void)((map)->stats.counter += seconds() - (start)))
+#endif
+
+
+/********** Hash Node Struct **********/
+
+// Chained entry; the display and free callbacks live on the owning HASHMAP
 typedef struct hnode {
     void *key;
     void *value;
-
-    void (*displayKey)(void *, FILE *);
-    void (*freeKey)(void *);
-    void (*displayValue)(void *, FILE *);
-    void (*freeValue)(void *);
+    struct hnode *next; // next entry in the same bucket
+    unsigned int hash;  // full hash of key, checked before the comparator
 } HNODE;
 
-HNODE *newHNODE(void *key, void *value) {
+HNODE *newHNODE(void *key, void *value, unsigned int hash) {
     HNODE *node = malloc(sizeof(HNODE));
+    assert(node != NULL);
     node->key = key;
     node->value = value;
+    node->next = NULL;
+    node->hash = hash;
     return node;
 }
 
-void setHNODEdisplayKey(HNODE *node, void (*display)(void *, FILE *)) {
-    assert(node != NULL);
-    node->displayKey = display;
-}
 
-void setHNODEdisplayValue(HNODE *node, void (*display)(void *, FILE *)) {
-    assert(node != NULL);
-    node->displayValue = display;
-}
+/********** Open Addressing Slot Struct **********/
 
-void setHNODEfreeKey(HNODE *node, void (*free)(void *)) {
-    assert(node != NULL);
-    node->freeKey = free;
-}
+typedef struct slot {
+    unsigned int hash;
+    void *key;      // NULL marks an empty slot, TOMBSTONE a deleted one
+    void *value;
+} SLOT;
 
-void setHNODEfreeValue(HNODE *node, void (*free)(void *)) {
-    assert(node != NULL);
-    node->freeValue = free;
-}
+static char tombstone;
+#define TOMBSTONE ((void *)&tombstone)
 
-void displayHNODE(void *node, FILE *fp) {
-    assert(node != NULL);
-    fprintf(fp, "(");
-    if (((HNODE *)node)->displayKey == NULL) {
-        // if no displayKey function is provided, print the address
-        fprintf(fp, "%p", ((HNODE *)node)->key);
-    }
-    else ((HNODE *)node)->displayKey(((HNODE *)node)->key, fp);
-    fprintf(fp, " : ");
-    if (((HNODE *)node)->displayValue == NULL) {
-        // if no displayValue function is provided, print the address
-        fprintf(fp, "%p", ((HNODE *)node)->value);
-    }
-    else ((HNODE *)node)->displayValue(((HNODE *)node)->value, fp);
-    fprintf(fp, ")");
-}
+// HASHMAP_SWISS keeps the top 7 hash bits in a slot's control byte; the low
+// bits already choose the home slot
+#define TAG(hash) ((unsigned char)((hash) >> 25))
 
-void freeHNODE(void *node) {
-    assert(node != NULL);
-    if (((HNODE *)node)->key != NULL && ((HNODE *)node)->freeKey != NULL) {
-        ((HNODE *)node)->freeKey(((HNODE *)node)->key);
-    }
-    if (((HNODE *)node)->value != NULL && ((HNODE *)node)->freeValue != NULL) {
-        ((HNODE *)node)->freeValue(((HNODE *)node)->value);
-    }
-    free(node);
-}
+// set on first use: 1 when the CPU can run the SSE2 group match
+static int haveSSE2 = -1;
+
+// CRC-32 lookup table for dump blocks, built once per process
+static uint32_t checksumTable[256];
+static pthread_once_t checksumOnce = PTHREAD_ONCE_INIT;
+
+// Both entry layouts keep value directly after key, so a value slot returned
+// by findEntry also locates the key stored beside it
+#define STORED_KEY(valueSlot) (*((valueSlot) - 1))
+typedef char hnodeLayoutCheck[offsetof(HNODE, value) == offsetof(HNODE, key) + sizeof(void *) ? 1 : -1];
+typedef char slotLayoutCheck[offsetof(SLOT, value) == offsetof(SLOT, key) + sizeof(void *) ? 1 : -1];
+
+// A map without a comparator compares keys by address alone, which suits
+// interned keys; any map can skip its comparator when the pointers match
+#define KEYS_EQUAL(map, a, b) \
+    ((a) == (b) || ((map)->compare != NULL && (COUNT(map, compares), (map)->compare(a, b) == 0)))
+
+// KEYS_EQUAL for pool workers, which leave the counters alone
+#define SAME_KEY(map, a, b) \
+    ((a) == (b) || ((map)->compare != NULL && (map)->compare(a, b) == 0))
+
+
+/********** Table Struct **********/
+
+typedef struct table {
+    int capacity;
+    int size;           // live entries held by this table
+    int tombstones;     // deleted slots (open addressing only)
+    HNODE **buckets;    // HASHMAP_CHAINED: head of each bucket's HNODE chain
+    SLOT *slots;        // open addressing backends: flat slot array
+    unsigned char *ctrl;    // HASHMAP_SWISS: control byte per slot, then a
+                            // copy of the first GROUP_WIDTH bytes
+} TABLE;
+
+
+/********** Distribution Report Struct **********/
+
+typedef struct report {
+    int capacity;
+    int *occupancy;         // entries whose home bucket is i
+    int *displacement;      // entries stored i slots past their home
+} REPORT;
+
+
+/********** Statistics Struct **********/
+
+// statsHASHMAP's tally of the probe lengths in one table
+typedef struct shape {
+    HASHMAPBACKEND backend;
+    int capacity;
+    int bucket;             // HASHMAP_CHAINED: bucket of the last entry seen
+    int depth;              // HASHMAP_CHAINED: that entry's place in its chain
+    HASHMAPSTATS *stats;
+} SHAPE;
+
+
+/********** Trace Ring Struct **********/
+
+struct HASHMAPTRACER {
+    HASHMAPTRACE *events;
+    int capacity;           // a power of two, so the next slot is found by masking
+    long count;             // events recorded, overwritten ones included
+};
+
+
+/********** Visitor Struct **********/
+
+// forEachHASHMAP's callback, carried through walkEntries
+typedef struct visitor {
+    void (*callback)(void *, void *, void *);
+    void *ctx;
+} VISITOR;
+
+
+/********** Parallel Job Structs **********/
+
+// One table walked by a parallel clear, free or forEach. Each worker takes
+// the slice of whole groups given by sliceStart.
+typedef struct sweep {
+    HASHMAP *map;
+    TABLE *table;
+    VISITOR *visitor;   // NULL frees the entries instead of visiting them
+} SWEEP;
+
+// buildHASHMAPparallel's working arrays, indexed by key unless noted
+typedef struct build {
+    HASHMAP *map;
+    void **keys;
+    void **values;
+    int count;
+    unsigned int *hashes;
+    int *order;         // key indices grouped by the worker owning their home slot
+    int *starts;        // worker w's keys are order[starts[w]] up to order[starts[w + 1]]
+    void **spares;      // pooled nodes set aside for the chained backend, or NULL
+    int *added;         // per worker: entries added
+    int *deferred;      // per worker: keys left at the front of its share of order
+} BUILD;
+
+
+/********** Snapshot Structs **********/
+
+// A snapshot file holds a SNAPHEADER, capacity + 1 bucket starts, the
+// SNAPENTRY array grouped by bucket, then the encoded keys and values.
+// Every reference is an offset from the start of the file, so a snapshot
+// can be mapped at any address. Integers are in the saver's byte order.
+typedef struct snapheader {
+    char magic[8];          // SNAPSHOT_MAGIC, without its NUL
+    uint32_t byteOrder;     // SNAPSHOT_BYTE_ORDER
+    uint32_t version;
+    uint32_t capacity;      // buckets, a power of two
+    uint32_t size;          // entries
+    uint64_t starts;        // bucket b holds entries starts[b] .. starts[b + 1] - 1
+    uint64_t entries;
+    uint64_t length;        // bytes in the whole file
+} SNAPHEADER;
+
+typedef struct snapentry {
+    uint32_t hash;          // the entry's cached hash
+    uint32_t keyLength;
+    uint32_t valueLength;
+    uint32_t hasValue;      // 0 when the value was NULL
+    uint64_t key;           // offset of the encoded key
+    uint64_t value;         // offset of the encoded value
+} SNAPENTRY;
+
+// saveHASHMAP's list of the entries to write
+typedef struct gather {
+    void ***pairs;          // each entry's key, followed by its value
+    unsigned int *hashes;
+    int count;
+} GATHER;
+
+
+/********** Dump Structs **********/
+
+// A dump is a DUMPHEADER followed by blocks, each a DUMPBLOCK and a payload
+// of records. A record is its key length and value length as uint32_t,
+// then the encoded key and value. An empty block ends the stream.
+typedef struct dumpheader {
+    char magic[8];          // DUMP_MAGIC, without its NUL
+    uint32_t byteOrder;     // SNAPSHOT_BYTE_ORDER
+    uint32_t version;
+    uint64_t entries;       // records in the whole stream
+} DUMPHEADER;
+
+typedef struct dumpblock {
+    uint32_t length;        // payload bytes
+    uint32_t records;
+    uint32_t checksum;      // CRC-32 of the payload
+} DUMPBLOCK;
+
+// dumpHASHMAP's block under construction
+typedef struct dump {
+    HASHMAP *map;
+    int fd;
+    unsigned char *block;
+    size_t size;            // bytes allocated for block
+    size_t used;            // bytes of complete records in block
+    uint32_t records;
+    bool ok;                // false once a write has failed
+} DUMP;
+
+// One decoded block waiting to be inserted
+typedef struct chunk {
+    void **keys;
+    void **values;
+    int count;
+    int capacity;
+} CHUNK;
+
+// restoreHASHMAP's reader and inserter, which share a ring of chunks
+typedef struct restore {
+    HASHMAP *map;
+    int fd;
+    unsigned char *block;   // the reader's raw block
+    size_t size;
+    CHUNK chunks[RESTORE_DEPTH];
+    long produced;          // chunks decoded so far
+    long consumed;          // chunks inserted so far
+    bool finished;          // the reader has stopped
+    bool ok;                // false once the stream proved short or corrupt
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} RESTORE;
+
+
+/********** Snapshot View Struct **********/
+
+struct HASHMAPVIEW {
+    const unsigned char *base;  // the read-only mapping of the file
+    size_t length;
+    const SNAPHEADER *header;
+    const uint32_t *starts;
+    const SNAPENTRY *entries;
+    int (*prehash)(void *);
+    size_t (*encodeKey)(void *, void *, size_t);
+};
 
 
 /********** Hash Map Struct **********/
 
 struct HASHMAP {
     int size;
-    int capacity;
     double loadFactor;
     int debugLevel;
-    DA *store;
+    HASHMAPBACKEND backend;
+    TABLE *table;
+
+    // incremental rehash state: while old is non-NULL, its buckets are
+    // migrated into table a few at a time, starting at rehashIndex
+    TABLE *old;
+    int rehashIndex;
+
+    // capacity set aside by reserveHASHMAP; removals never shrink below it
+    int reserved;
 
     void (*displayKey)(void *, FILE *);
     void (*displayValue)(void *, FILE *);
     void (*freeKey)(void *);
     void (*freeValue)(void *);
     int (*prehash)(void *);
+
+    // codecs used by snapshots; see saveHASHMAP
+    size_t (*encodeKey)(void *, void *, size_t);
+    void *(*decodeKey)(const void *, size_t);
+    size_t (*encodeValue)(void *, void *, size_t);
+    void *(*decodeValue)(const void *, size_t);
     int (*compare)(void *, void *);
+
+    // optional node pool for the chained backend; NULL uses malloc
+    SLAB *hnodes;
+
+    // counters reported by statsHASHMAP; the histogram fields stay zero
+    HASHMAPSTATS stats;
+
+    // optional trace callback; see setHASHMAPtrace
+    void (*trace)(const HASHMAPTRACE *, void *);
+    void *traceContext;
+
+    // Backend Methods
+    TABLE *(*newTable)(HASHMAP *, int);
+    void (*freeEntries)(HASHMAP *, TABLE *, int, int);
+    void **(*findEntry)(HASHMAP *, TABLE *, void *, unsigned int);
+    void **(*findOrAddEntry)(HASHMAP *, TABLE *, void *, unsigned int, void **);
+    void **(*claimEntry)(HASHMAP *, TABLE *, void *, unsigned int, int, void **, void **);
+    void *(*removeEntry)(HASHMAP *, TABLE *, void *, unsigned int, void **);
+    void (*migrateBucket)(HASHMAP *, TABLE *, int, TABLE *);
+    void (*displayBucket)(HASHMAP *, TABLE *, int, FILE *);
+    void (*walkEntries)(HASHMAP *, TABLE *, int, int, void (*)(void *, void **, unsigned int, int), void *);
+    bool (*stepEntry)(HASHMAP *, HASHMAPITER *);
+    void *(*removeCurrentEntry)(HASHMAP *, HASHMAPITER *, void **);
+    void (*prefetchEntry)(HASHMAP *, TABLE *, unsigned int, int);
 };
 
 
 /********** Private Method Prototypes **********/
 static int thresholdHASHMAP(HASHMAP *map);
-static int hash(HASHMAP *map, void *key);
+static double loadFactorHASHMAP(HASHMAP *map);
+static int capacityFor(HASHMAP *map, int entries);
+static void presizeHASHMAP(HASHMAP *map, int entries);
+static unsigned int hash(HASHMAP *map, void *key);
+static unsigned int hashKey(HASHMAP *map, void *key);
+static unsigned int mix(unsigned int h);
+static int indexFor(unsigned int hash, int capacity);
+static void countEntry(void *report, void **pair, unsigned int hash, int position);
+static void measureEntry(void *shape, void **pair, unsigned int hash, int position);
+static size_t tableBytes(HASHMAP *map, TABLE *table);
+#if !defined(HASHMAP_NO_STATS)
+static double seconds(void);
+#endif
+static void visitEntry(void *visitor, void **pair, unsigned int hash, int position);
+static void displayEntry(HASHMAP *map, void *key, void *value, FILE *fp);
+static void traceEvent(HASHMAP *map, HASHMAPEVENT event, void *key, unsigned int hash, bool found);
+static void **findHASHMAPentry(HASHMAP *map, void *key, unsigned int hash);
+static void **upsertHASHMAP(HASHMAP *map, void *key, unsigned int hash, void **stored);
+static HNODE *allocHNODE(HASHMAP *map, void *key, void *value, unsigned int hash);
+static void releaseHNODE(HASHMAP *map, HNODE *node);
+static void freeEntry(HASHMAP *map, void *key, void *value);
+static void assignEntry(HASHMAP *map, void **slot, void *stored, void *key, void *value);
+static void freeTable(HASHMAP *map, TABLE *table);
+static void dropTable(TABLE *table);
+static void prepareInsert(HASHMAP *map);
+static void resize(HASHMAP *map, int newCapacity);
+static void rehashStep(HASHMAP *map, int steps);
+static void finishRehash(HASHMAP *map);
+static int sliceStart(int capacity, int worker, int workers);
+static int sliceOwner(int capacity, int index, int workers);
+static void runJob(THREADPOOL *pool, void (*task)(void *, int, int), void *job);
+static void sweepTable(HASHMAP *map, TABLE *table, VISITOR *visitor, THREADPOOL *pool);
+static void sweepSlice(void *job, int worker, int workers);
+static void releaseTables(HASHMAP *map, THREADPOOL *pool);
+static void hashSlice(void *job, int worker, int workers);
+static void claimSlice(void *job, int worker, int workers);
+static void gatherEntry(void *gather, void **pair, unsigned int hash, int position);
+static bool writeItem(FILE *fp, size_t (*encode)(void *, void *, size_t), void *item,
+        unsigned char **buffer, size_t *bufferSize, uint64_t *offset, uint32_t *length);
+static bool validSection(uint64_t offset, uint64_t count, size_t size, size_t length);
+static bool validEntry(const SNAPENTRY *entry, size_t length);
+static const SNAPENTRY *findViewEntry(HASHMAPVIEW *view, void *key);
+static void buildChecksumTable(void);
+static uint32_t checksum(const unsigned char *bytes, size_t length);
+static bool writeAll(int fd, const void *bytes, size_t length);
+static bool readAll(int fd, void *bytes, size_t length);
+static void dumpEntry(void *dump, void **pair, unsigned int hash, int position);
+static bool flushDump(DUMP *dump);
+static int readChunk(RESTORE *restore, CHUNK *chunk);
+static void insertChunk(HASHMAP *map, CHUNK *chunk);
+static void discardChunk(HASHMAP *map, CHUNK *chunk);
+static void restoreWorker(void *restore, int worker, int workers);
+// HASHMAP_CHAINED
+static TABLE *newChainedTable(HASHMAP *map, int capacity);
+static void freeChainedEntries(HASHMAP *map, TABLE *table, int from, int to);
+static void **findChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash);
+static void **findOrAddChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **stored);
+static void **claimChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, int limit, void **spare, void **stored);
+static void *removeChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **value);
+static void migrateChainedBucket(HASHMAP *map, TABLE *from, int index, TABLE *to);
+static void displayChainedBucket(HASHMAP *map, TABLE *table, int index, FILE *fp);
+static void walkChainedEntries(HASHMAP *map, TABLE *table, int from, int to, void (*visit)(void *, void **, unsigned int, int), void *ctx);
+static void prefetchChainedEntry(HASHMAP *map, TABLE *table, unsigned int hash, int stage);
+static bool stepChainedEntry(HASHMAP *map, HASHMAPITER *iter);
+static void *removeChainedCurrent(HASHMAP *map, HASHMAPITER *iter, void **value);
+// HASHMAP_LINEAR_PROBING
+static TABLE *newLinearTable(HASHMAP *map, int capacity);
+static void freeLinearEntries(HASHMAP *map, TABLE *table, int from, int to);
+static void **findLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash);
+static void **findOrAddLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **stored);
+static void **claimLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, int limit, void **spare, void **stored);
+static void addLinearEntry(HASHMAP *map, TABLE *table, void *key, void *value, unsigned int hash);
+static void *removeLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **value);
+static void migrateLinearBucket(HASHMAP *map, TABLE *from, int index, TABLE *to);
+static void displayLinearBucket(HASHMAP *map, TABLE *table, int index, FILE *fp);
+static void walkLinearEntries(HASHMAP *map, TABLE *table, int from, int to, void (*visit)(void *, void **, unsigned int, int), void *ctx);
+static void prefetchLinearEntry(HASHMAP *map, TABLE *table, unsigned int hash, int stage);
+static bool stepLinearEntry(HASHMAP *map, HASHMAPITER *iter);
+static void *removeLinearCurrent(HASHMAP *map, HASHMAPITER *iter, void **value);
+// HASHMAP_SWISS
+static void detectSIMD(void);
+static unsigned int matchControl(const unsigned char *group, unsigned char control);
+static unsigned int matchFree(const unsigned char *group);
+static int lowestBit(unsigned int mask);
+static void setControl(TABLE *table, int index, unsigned char control);
+static TABLE *newSwissTable(HASHMAP *map, int capacity);
+static void freeSwissEntries(HASHMAP *map, TABLE *table, int from, int to);
+static void **findSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash);
+static void **findOrAddSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **stored);
+static void **claimSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, int limit, void **spare, void **stored);
+static void addSwissEntry(HASHMAP *map, TABLE *table, void *key, void *value, unsigned int hash);
+static void *removeSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **value);
+static void migrateSwissBucket(HASHMAP *map, TABLE *from, int index, TABLE *to);
+static void displaySwissBucket(HASHMAP *map, TABLE *table, int index, FILE *fp);
+static void walkSwissEntries(HASHMAP *map, TABLE *table, int from, int to, void (*visit)(void *, void **, unsigned int, int), void *ctx);
+static void prefetchSwissEntry(HASHMAP *map, TABLE *table, unsigned int hash, int stage);
+static bool stepSwissEntry(HASHMAP *map, HASHMAPITER *iter);
+static void *removeSwissCurrent(HASHMAP *map, HASHMAPITER *iter, void **value);
 
 
 /********** Public Method Definitions **********/
 
 HASHMAP *newHASHMAP(int (*prehash)(void *), int (*comparator)(void *, void *)) {
+    return newHASHMAPbackend(prehash, comparator, HASHMAP_CHAINED);
+}
+
+HASHMAP *newHASHMAPbackend(int (*prehash)(void *),
+        int (*comparator)(void *, void *), HASHMAPBACKEND backend) {
+    return newHASHMAPreserved(prehash, comparator, backend, 0);
+}
+
+HASHMAP *newHASHMAPreserved(int (*prehash)(void *),
+        int (*comparator)(void *, void *), HASHMAPBACKEND backend, int entries) {
+    // Allocates the table for entries keys up front, as reserveHASHMAP would.
+    assert(entries >= 0);
     HASHMAP *map = malloc(sizeof(HASHMAP));
     assert(map != NULL);
     map->size = 0;
-    map->capacity = INITIAL_CAPACITY;
     map->loadFactor = DEFAULT_LOAD_FACTOR;
     map->debugLevel = 0;
-    // create store and initialize with singly-linked lists
-    map->store = newDA();
-    for (int i = 0; i < map->capacity; ++i) {
-        insertDAback(map->store, newSLL(displayHNODE, freeHNODE));
-    }
-    shrinkToFitDA(map->store);
+    map->backend = backend;
+    map->old = NULL;
+    map->rehashIndex = 0;
+    map->reserved = INITIAL_CAPACITY;
+    map->displayKey = NULL;
+    map->displayValue = NULL;
+    map->freeKey = NULL;
+    map->freeValue = NULL;
     map->prehash = prehash;
+    map->encodeKey = NULL;
+    map->decodeKey = NULL;
+    map->encodeValue = NULL;
+    map->decodeValue = NULL;
     map->compare = comparator;
+    map->hnodes = NULL;
+    memset(&map->stats, 0, sizeof(map->stats));
+    map->trace = NULL;
+    map->traceContext = NULL;
+    switch (backend) {
+        case HASHMAP_CHAINED:
+            map->newTable = newChainedTable;
+            map->freeEntries = freeChainedEntries;
+            map->findEntry = findChainedEntry;
+            map->findOrAddEntry = findOrAddChainedEntry;
+            map->claimEntry = claimChainedEntry;
+            map->removeEntry = removeChainedEntry;
+            map->migrateBucket = migrateChainedBucket;
+            map->displayBucket = displayChainedBucket;
+            map->walkEntries = walkChainedEntries;
+            map->prefetchEntry = prefetchChainedEntry;
+            map->stepEntry = stepChainedEntry;
+            map->removeCurrentEntry = removeChainedCurrent;
+            break;
+        case HASHMAP_LINEAR_PROBING:
+            map->newTable = newLinearTable;
+            map->freeEntries = freeLinearEntries;
+            map->findEntry = findLinearEntry;
+            map->findOrAddEntry = findOrAddLinearEntry;
+            map->claimEntry = claimLinearEntry;
+            map->removeEntry = removeLinearEntry;
+            map->migrateBucket = migrateLinearBucket;
+            map->displayBucket = displayLinearBucket;
+            map->walkEntries = walkLinearEntries;
+            map->prefetchEntry = prefetchLinearEntry;
+            map->stepEntry = stepLinearEntry;
+            map->removeCurrentEntry = removeLinearCurrent;
+            break;
+        case HASHMAP_SWISS:
+            detectSIMD();
+            map->newTable = newSwissTable;
+            map->freeEntries = freeSwissEntries;
+            map->findEntry = findSwissEntry;
+            map->findOrAddEntry = findOrAddSwissEntry;
+            map->claimEntry = claimSwissEntry;
+            map->removeEntry = removeSwissEntry;
+            map->migrateBucket = migrateSwissBucket;
+            map->displayBucket = displaySwissBucket;
+            map->walkEntries = walkSwissEntries;
+            map->prefetchEntry = prefetchSwissEntry;
+            map->stepEntry = stepSwissEntry;
+            map->removeCurrentEntry = removeSwissCurrent;
+            break;
+        default:
+            assert(!"unknown HASHMAP backend");
+            free(map);
+            return NULL;
+    }
+    map->reserved = capacityFor(map, entries);
+    map->table = map->newTable(map, map->reserved);
     return map;
 }
 
@@ -151,6 +601,33 @@ void setHASHMAPfreeValue(HASHMAP *map, void (*free)(void *)) {
     map->freeValue = free;
 }
 
+void setHASHMAPkeyCodec(HASHMAP *map, size_t (*encode)(void *, void *, size_t),
+        void *(*decode)(const void *, size_t)) {
+    // encode(key, buffer, size) writes key's encoding to buffer if it fits
+    // in size bytes and returns its length either way; decode(bytes, length)
+    // returns a new key. Equal keys must encode to the same bytes.
+    assert(map != NULL);
+    map->encodeKey = encode;
+    map->decodeKey = decode;
+}
+
+void setHASHMAPvalueCodec(HASHMAP *map, size_t (*encode)(void *, void *, size_t),
+        void *(*decode)(const void *, size_t)) {
+    // as setHASHMAPkeyCodec, for values
+    assert(map != NULL);
+    map->encodeValue = encode;
+    map->decodeValue = decode;
+}
+
+void setHASHMAPtrace(HASHMAP *map, void (*trace)(const HASHMAPTRACE *, void *), void *ctx) {
+    // Calls trace(event, ctx) on every probe, insert, remove and resize made
+    // by the calling thread; buildHASHMAPparallel's workers do not trace.
+    // The callback must not modify the map. A NULL trace turns tracing off.
+    assert(map != NULL);
+    map->trace = trace;
+    map->traceContext = ctx;
+}
+
 double setHASHMAPloadFactor(HASHMAP *map, double loadFactor) {
     assert(map != NULL);
     assert(loadFactor > 0);
@@ -159,89 +636,305 @@ double setHASHMAPloadFactor(HASHMAP *map, double loadFactor) {
     return oldLoadFactor;
 }
 
+void setHASHMAPnodePool(HASHMAP *map, bool enabled) {
+    // Switches the chained backend between malloc and a per-map slab for its
+    // HNODEs. Only an empty map may switch.
+    assert(map != NULL);
+    assert(map->size == 0 && map->old == NULL);
+    if (enabled == (map->hnodes != NULL)) return;
+    if (enabled) map->hnodes = newSLAB(sizeof(HNODE));
+    else {
+        freeSLAB(map->hnodes);
+        map->hnodes = NULL;
+    }
+}
+
+bool statsHASHMAPpool(HASHMAP *map, SLABSTATS *stats) {
+    // Fills stats with the usage of the map's node slab. The block size is
+    // the pool memory drawn per entry. Returns false without a pool.
+    assert(map != NULL);
+    assert(stats != NULL);
+    if (map->hnodes == NULL) return false;
+    statsSLAB(map->hnodes, stats);
+    return true;
+}
+
+void statsHASHMAP(HASHMAP *map, HASHMAPSTATS *stats) {
+    // Copies the counters into stats, then walks the tables for the probe
+    // length histogram, the longest probe and the bytes held. The walk
+    // touches every bucket, so it costs about as much as forEachHASHMAP.
+    assert(map != NULL);
+    assert(stats != NULL);
+    *stats = map->stats;
+    stats->bytes = sizeof(HASHMAP);
+    TABLE *tables[] = {map->table, map->old};
+    for (int t = 0; t < 2; ++t) {
+        if (tables[t] == NULL) continue;
+        SHAPE shape = {map->backend, tables[t]->capacity, -1, 0, stats};
+        map->walkEntries(map, tables[t], 0, tables[t]->capacity, measureEntry, &shape);
+        stats->bytes += tableBytes(map, tables[t]);
+    }
+    if (map->hnodes != NULL) {
+        SLABSTATS pool;
+        statsSLAB(map->hnodes, &pool);
+        stats->bytes += pool.bytes;
+    }
+}
+
+void reserveHASHMAP(HASHMAP *map, int entries) {
+    // Sizes the table so that entries keys fit without a resize, and keeps
+    // at least that capacity until shrinkToFitHASHMAP is called.
+    assert(map != NULL);
+    assert(entries >= 0);
+    int capacity = capacityFor(map, entries);
+    if (capacity > map->reserved) map->reserved = capacity;
+    presizeHASHMAP(map, entries);
+}
+
+void shrinkToFitHASHMAP(HASHMAP *map) {
+    // Drops any reservation and rebuilds the table at the smallest capacity
+    // that holds the current entries, which also purges tombstones.
+    assert(map != NULL);
+    finishRehash(map);
+    map->reserved = INITIAL_CAPACITY;
+    int capacity = capacityFor(map, map->size);
+    if (capacity == map->table->capacity && map->table->tombstones == 0) return;
+    resize(map, capacity);
+    finishRehash(map);
+}
+
 void insertHASHMAP(HASHMAP *map, void *key, void *value) {
+    // Inserts key or replaces its value.
+    assert(map != NULL);
+    assert(key != NULL);
+    void *stored;
+    void **slot = upsertHASHMAP(map, key, hash(map, key), &stored);
+    assignEntry(map, slot, stored, key, value);
+}
+
+void *insertOrAssignHASHMAP(HASHMAP *map, void *key, void *value) {
+    // Returns the value key previously mapped to, or NULL.
+    assert(map != NULL);
+    assert(key != NULL);
+    void *stored;
+    void **slot = upsertHASHMAP(map, key, hash(map, key), &stored);
+    void *old = stored == NULL ? NULL : *slot;
+    *slot = value;
+    return old;
+}
+
+bool insertIfAbsentHASHMAP(HASHMAP *map, void *key, void *value) {
+    // Returns false, leaving the map and value untouched, if key is
+    // already present.
+    assert(map != NULL);
+    assert(key != NULL);
+    void *stored;
+    void **slot = upsertHASHMAP(map, key, hash(map, key), &stored);
+    if (stored != NULL) return false;
+    *slot = value;
+    return true;
+}
+
+void **getOrInsertHASHMAP(HASHMAP *map, void *key, bool *inserted) {
+    // Returns the address of key's value, adding key with a NULL value if it
+    // is absent. The address is valid until the map is next modified.
     assert(map != NULL);
     assert(key != NULL);
-    // grow the store if the size of the map exceeds the calculated threshold
-    if (map->size > thresholdHASHMAP(map)) {
-        /* grow(map); */
-    }
-    // create HNODE for the key/value pair
-    HNODE *node = newHNODE(key, value);
-    setHNODEdisplayKey(node, map->displayKey);
-    setHNODEdisplayValue(node, map->displayValue);
-    setHNODEfreeKey(node, map->freeKey);
-    setHNODEfreeValue(node, map->freeValue);
-    // get hash value
-    int index = hash(map, key);
-    // get sll chain at correct hash index
-    SLL *chain = getDA(map->store, index);
-    // insert key/value into correct spot
-    insertSLL(chain, sizeSLL(chain), node);
-    map->size++;
+    void *stored;
+    void **slot = upsertHASHMAP(map, key, hash(map, key), &stored);
+    if (inserted != NULL) *inserted = stored == NULL;
+    return slot;
 }
 
 void *removeHASHMAP(HASHMAP *map, void *key) {
     assert(map != NULL);
     assert(key != NULL);
-    int hashIndex = hash(map, key);
-    SLL *chain = getDA(map->store, hashIndex);
-    for (int i = 0; i < sizeSLL(chain); ++i) {
-        if (map->compare(((HNODE *)getSLL(chain, i))->key, key) == 0) {
-            HNODE *node = removeSLL(chain, i);
-            void *result = node->key;
-            node->freeValue(node->value);
-            free(node);
-            return result;
-        }
+    rehashStep(map, REHASH_STEPS);
+    unsigned int h = hash(map, key);
+    void *value;
+    void *result = map->removeEntry(map, map->table, key, h, &value);
+    if (result == NULL && map->old != NULL) {
+        result = map->removeEntry(map, map->old, key, h, &value);
     }
-    return NULL;
+    if (result == NULL) return NULL;
+    if (value != NULL && map->freeValue != NULL) {
+        map->freeValue(value);
+    }
+    map->size--;
+    COUNT(map, removes);
+    TRACE(map, HASHMAP_TRACE_REMOVE, result, h, true);
+    // shrink the table once occupancy drops far below the threshold
+    if (map->table->capacity > map->reserved
+            && map->size < thresholdHASHMAP(map) * SHRINK_RATIO) {
+        resize(map, map->table->capacity / GROWTH_FACTOR);
+    }
+    return result;
 }
 
 void *getHASHMAPvalue(HASHMAP *map, void *key) {
     assert(map != NULL);
     assert(key != NULL);
-    int index = hash(map, key);
-    SLL *chain = getDA(map->store, index);
-    for (int i = 0; i < sizeSLL(chain); ++i) {
-        if (map->compare(((HNODE *)getSLL(chain, i))->key, key) == 0) {
-            return ((HNODE *)getSLL(chain, i))->value;
+    rehashStep(map, REHASH_STEPS);
+    void **value = findHASHMAPentry(map, key, hash(map, key));
+    // if key is not found, return NULL
+    if (value == NULL) return NULL;
+    return *value;
+}
+
+void insertHASHMAPbatch(HASHMAP *map, void **keys, void **values, int count) {
+    // Inserts keys[i] -> values[i] as insertHASHMAP would. The table is sized
+    // for the whole batch first, then each window of keys is hashed and its
+    // buckets prefetched before any of them is probed.
+    assert(map != NULL);
+    assert(keys != NULL && values != NULL);
+    assert(count >= 0);
+    presizeHASHMAP(map, map->size + count);
+    unsigned int hashes[BATCH_WINDOW];
+    for (int start = 0; start < count; start += BATCH_WINDOW) {
+        int n = count - start < BATCH_WINDOW ? count - start : BATCH_WINDOW;
+        for (int i = 0; i < n; ++i) {
+            assert(keys[start + i] != NULL);
+            hashes[i] = hash(map, keys[start + i]);
+            map->prefetchEntry(map, map->table, hashes[i], 0);
+        }
+        for (int stage = 1; stage < PREFETCH_STAGES; ++stage) {
+            for (int i = 0; i < n; ++i) map->prefetchEntry(map, map->table, hashes[i], stage);
+        }
+        for (int i = 0; i < n; ++i) {
+            void *stored;
+            void **slot = upsertHASHMAP(map, keys[start + i], hashes[i], &stored);
+            assignEntry(map, slot, stored, keys[start + i], values[start + i]);
         }
     }
-    // if key is not found, return NULL
-    return NULL;
 }
 
-void clearHASHMAP(HASHMAP *map) {
+void getHASHMAPbatch(HASHMAP *map, void **keys, void **values, int count) {
+    // Stores the value of keys[i] in values[i], or NULL if it is absent,
+    // overlapping the cache misses of a window of keys at a time.
+    assert(map != NULL);
+    assert(keys != NULL && values != NULL);
+    assert(count >= 0);
+    unsigned int hashes[BATCH_WINDOW];
+    for (int start = 0; start < count; start += BATCH_WINDOW) {
+        int n = count - start < BATCH_WINDOW ? count - start : BATCH_WINDOW;
+        rehashStep(map, REHASH_STEPS * n);
+        for (int i = 0; i < n; ++i) {
+            assert(keys[start + i] != NULL);
+            hashes[i] = hash(map, keys[start + i]);
+            map->prefetchEntry(map, map->table, hashes[i], 0);
+        }
+        for (int stage = 1; stage < PREFETCH_STAGES; ++stage) {
+            for (int i = 0; i < n; ++i) map->prefetchEntry(map, map->table, hashes[i], stage);
+        }
+        for (int i = 0; i < n; ++i) {
+            void **value = findHASHMAPentry(map, keys[start + i], hashes[i]);
+            values[start + i] = value == NULL ? NULL : *value;
+        }
+    }
+}
+
+void buildHASHMAPparallel(HASHMAP *map, THREADPOOL *pool, void **keys, void **values, int count) {
+    // Inserts keys[i] -> values[i] as insertHASHMAPbatch would. The keys are
+    // hashed in parallel, then each goes to the worker whose slice of the
+    // table holds its home slot, so no two workers write the same bucket.
+    // Open addressing probes that would run past the end of a slice are
+    // finished serially afterwards. The prehash, comparator and free
+    // callbacks run on several workers at once, and a key object that
+    // appears twice in keys may be hashed by two workers at once, so any
+    // hash it caches must be filled in atomically, as prehashSTRING does.
+    // A NULL pool runs serially.
     assert(map != NULL);
-    // clear the store
-    for (int i = 0; i < map->capacity; ++i) {
-        freeSLL(getDA(map->store, i));
+    assert(keys != NULL && values != NULL);
+    assert(count >= 0);
+    if (count < PARALLEL_GRAIN) pool = NULL;
+    presizeHASHMAP(map, map->size + count);
+    finishRehash(map);
+    // slices are claimed without reusing deleted slots, so purge them first
+    if (map->table->tombstones > 0) {
+        resize(map, map->table->capacity);
+        finishRehash(map);
+    }
+    int workers = pool == NULL ? 1 : sizeTHREADPOOL(pool);
+    int capacity = map->table->capacity;
+    BUILD build = {map, keys, values, count, NULL, NULL, NULL, NULL, NULL, NULL};
+    build.hashes = malloc(sizeof(unsigned int) * (count + 1));
+    build.order = malloc(sizeof(int) * (count + 1));
+    build.starts = calloc(workers + 1, sizeof(int));
+    build.added = calloc(workers, sizeof(int));
+    build.deferred = calloc(workers, sizeof(int));
+    int *next = malloc(sizeof(int) * workers);
+    assert(build.hashes != NULL && build.order != NULL && build.starts != NULL);
+    assert(build.added != NULL && build.deferred != NULL && next != NULL);
+    runJob(pool, hashSlice, &build);
+    // counting sort of the key indices by owning worker
+    for (int i = 0; i < count; ++i) {
+        build.starts[sliceOwner(capacity, indexFor(build.hashes[i], capacity), workers) + 1]++;
+    }
+    for (int w = 0; w < workers; ++w) {
+        build.starts[w + 1] += build.starts[w];
+        next[w] = build.starts[w];
+    }
+    for (int i = 0; i < count; ++i) {
+        build.order[next[sliceOwner(capacity, indexFor(build.hashes[i], capacity), workers)]++] = i;
+    }
+    // the node slab is not thread-safe, so pooled nodes are drawn up front
+    if (map->backend == HASHMAP_CHAINED && map->hnodes != NULL) {
+        build.spares = malloc(sizeof(void *) * (count + 1));
+        assert(build.spares != NULL);
+        for (int i = 0; i < count; ++i) build.spares[i] = allocSLAB(map->hnodes);
+    }
+    runJob(pool, claimSlice, &build);
+    int added = 0;
+    for (int w = 0; w < workers; ++w) added += build.added[w];
+    map->size += added;
+    map->table->size += added;
+    COUNT_MANY(map, inserts, added);
+    if (map->prehash != NULL) COUNT_MANY(map, prehashes, count);
+    for (int w = 0; w < workers; ++w) {
+        for (int j = 0; j < build.deferred[w]; ++j) {
+            int i = build.order[build.starts[w] + j];
+            void *stored;
+            void **slot = upsertHASHMAP(map, keys[i], build.hashes[i], &stored);
+            assignEntry(map, slot, stored, keys[i], values[i]);
+        }
     }
-    freeDA(map->store);
+    if (build.spares != NULL) {
+        // spares of duplicate keys were never linked in
+        for (int i = 0; i < count; ++i) {
+            if (build.spares[i] != NULL) releaseSLAB(map->hnodes, build.spares[i]);
+        }
+        free(build.spares);
+    }
+    free(next);
+    free(build.deferred);
+    free(build.added);
+    free(build.starts);
+    free(build.order);
+    free(build.hashes);
+}
+
+void clearHASHMAP(HASHMAP *map) {
+    clearHASHMAPparallel(map, NULL);
+}
+
+void clearHASHMAPparallel(HASHMAP *map, THREADPOOL *pool) {
+    // Empties the map as clearHASHMAP does, freeing the entries of each
+    // slice of the table on a different worker. The free callbacks run on
+    // several workers at once. A NULL pool runs serially.
+    assert(map != NULL);
+    releaseTables(map, pool);
+    // every pooled node is free again, so hand the slabs back in bulk
+    if (map->hnodes != NULL) clearSLAB(map->hnodes);
     // reset fields
     map->size = 0;
-    map->capacity = INITIAL_CAPACITY;
-    // create store and initialize with singly-linked lists
-    map->store = newDA();
-    for (int i = 0; i < map->capacity; ++i) {
-        insertDAback(map->store, newSLL(displayHNODE, freeHNODE));
-    }
-    shrinkToFitDA(map->store);
+    map->table = map->newTable(map, map->reserved);
 }
 
 bool containsKey(HASHMAP *map, void *key) {
     assert(map != NULL);
     assert(key != NULL);
-    int index = hash(map, key);
-    SLL *chain = getDA(map->store, index);
-    printf("index: %d\n", index);
-    for (int i = 0; i < sizeSLL(chain); ++i) {
-        if (map->compare(((HNODE *)getSLL(chain, i))->key, key) == 0) {
-            return true;
-        }
-    }
-    return false;
+    rehashStep(map, REHASH_STEPS);
+    return findHASHMAPentry(map, key, hash(map, key)) != NULL;
 }
 
 bool isHASHMAPempty(HASHMAP *map) {
@@ -256,50 +949,1822 @@ int sizeHASHMAP(HASHMAP *map) {
 
 void displayHASHMAP(HASHMAP *map, FILE *fp) {
     assert(map != NULL);
+    // settle any pending rehash so every entry is shown in a single table
+    finishRehash(map);
     if (map->debugLevel > 0) {
         fprintf(fp, "Size: %d\n", map->size);
-        fprintf(fp, "Capacity: %d\n", map->capacity);
+        fprintf(fp, "Capacity: %d\n", map->table->capacity);
         fprintf(fp, "Load Factor: %f\n", map->loadFactor);
         fprintf(fp, "Threshold: %d\n", thresholdHASHMAP(map));
     }
     fprintf(fp, "[");
-    for (int i = 0; i < map->capacity; ++i) {
+    for (int i = 0; i < map->table->capacity; ++i) {
         fprintf(fp, "%d: ", i);
-        if (map->debugLevel > 0) {
-            displaySLLdebug(getDA(map->store, i), fp);
-        }
-        else displaySLL(getDA(map->store, i), fp);
-        if (i < map->capacity - 1) fprintf(fp, ", ");
+        map->displayBucket(map, map->table, i, fp);
+        if (i < map->table->capacity - 1) fprintf(fp, ", ");
     }
     fprintf(fp, "]");
 }
 
+void displayHASHMAPdistribution(HASHMAP *map, FILE *fp) {
+    // Reports how evenly the hashed keys spread over the buckets, next to the
+    // Poisson occupancy an ideal hash function would produce at this load.
+    assert(map != NULL);
+    finishRehash(map);
+    int capacity = map->table->capacity;
+    REPORT report;
+    report.capacity = capacity;
+    report.occupancy = calloc(capacity, sizeof(int));
+    report.displacement = calloc(capacity, sizeof(int));
+    assert(report.occupancy != NULL && report.displacement != NULL);
+    map->walkEntries(map, map->table, 0, map->table->capacity, countEntry, &report);
+    int buckets[REPORT_BUCKETS + 1] = {0};
+    int longest = 0;
+    for (int i = 0; i < capacity; ++i) {
+        int load = report.occupancy[i];
+        if (load > longest) longest = load;
+        buckets[load < REPORT_BUCKETS ? load : REPORT_BUCKETS]++;
+    }
+    double lambda = (double)map->size / capacity;
+    fprintf(fp, "Entries: %d\n", map->size);
+    fprintf(fp, "Buckets: %d\n", capacity);
+    fprintf(fp, "Load: %f\n", lambda);
+    fprintf(fp, "Longest Chain: %d\n", longest);
+    fprintf(fp, "Occupancy    Buckets   Expected\n");
+    double p = exp(-lambda), tail = 1.0;
+    for (int k = 0; k <= REPORT_BUCKETS; ++k) {
+        double expected = (k < REPORT_BUCKETS) ? p : tail;
+        fprintf(fp, "%s%-9d %10d %10.1f\n", (k < REPORT_BUCKETS) ? " " : ">=", k,
+                buckets[k], expected * capacity);
+        tail -= p;
+        p *= lambda / (k + 1);
+    }
+    if (map->backend != HASHMAP_CHAINED) {
+        fprintf(fp, "Displacement    Entries\n");
+        for (int i = 0; i < capacity; ++i) {
+            if (report.displacement[i] > 0) {
+                fprintf(fp, "%12d %10d\n", i, report.displacement[i]);
+            }
+        }
+    }
+    free(report.occupancy);
+    free(report.displacement);
+}
+
+bool firstHASHMAP(HASHMAP *map, HASHMAPITER *iter) {
+    // Places iter on the first entry in memory order, returning false if the
+    // map is empty. Any pending rehash is finished first, so one table holds
+    // every entry for the rest of the walk.
+    assert(map != NULL);
+    assert(iter != NULL);
+    finishRehash(map);
+    iter->map = map;
+    iter->index = -1;
+    iter->pair = NULL;
+    iter->link = NULL;
+    iter->removed = false;
+    return map->stepEntry(map, iter);
+}
+
+bool nextHASHMAP(HASHMAPITER *iter) {
+    // Advances iter to the next entry, returning false past the last one.
+    assert(iter != NULL && iter->map != NULL);
+    return iter->map->stepEntry(iter->map, iter);
+}
+
+void *keyHASHMAPiter(HASHMAPITER *iter) {
+    assert(iter != NULL && iter->pair != NULL);
+    return iter->pair[0];
+}
+
+void *valueHASHMAPiter(HASHMAPITER *iter) {
+    // entries keep their value right after their key, see STORED_KEY
+    assert(iter != NULL && iter->pair != NULL);
+    return iter->pair[1];
+}
+
+void *removeHASHMAPiter(HASHMAPITER *iter) {
+    // Removes the entry under iter as removeHASHMAP would, returning its key
+    // and freeing its value; nextHASHMAP then moves on to the entry that
+    // followed it. The table is not shrunk while iterating.
+    assert(iter != NULL && iter->pair != NULL);
+    HASHMAP *map = iter->map;
+    void *value;
+    void *key = map->removeCurrentEntry(map, iter, &value);
+    if (value != NULL && map->freeValue != NULL) map->freeValue(value);
+    map->size--;
+    COUNT(map, removes);
+    TRACE(map, HASHMAP_TRACE_REMOVE, key, hashKey(map, key), true);
+    iter->pair = NULL;
+    iter->removed = true;
+    return key;
+}
+
+void forEachHASHMAP(HASHMAP *map, void (*callback)(void *, void *, void *), void *ctx) {
+    // Calls callback(key, value, ctx) for every entry, walking each table in
+    // memory order; a rehash in progress is left alone. The callback must
+    // not modify the map; use an iterator to remove entries while walking.
+    forEachHASHMAPparallel(map, NULL, callback, ctx);
+}
+
+void forEachHASHMAPparallel(HASHMAP *map, THREADPOOL *pool,
+        void (*callback)(void *, void *, void *), void *ctx) {
+    // As forEachHASHMAP, but each slice of a table is walked by a different
+    // worker, so callback runs on several threads at once. A NULL pool runs
+    // serially.
+    assert(map != NULL);
+    assert(callback != NULL);
+    VISITOR visitor = {callback, ctx};
+    if (map->old != NULL) sweepTable(map, map->old, &visitor, pool);
+    sweepTable(map, map->table, &visitor, pool);
+}
+
+bool saveHASHMAP(HASHMAP *map, const char *path) {
+    // Writes the map to path as a snapshot that loadHASHMAPview can map and
+    // query in place. Entries keep their cached hashes and stay grouped by
+    // the bucket they occupy now; keys and values are written with the
+    // map's codecs. The file is written beside path and renamed over it, so
+    // no reader ever maps a half-written snapshot. Returns false if the
+    // file cannot be written.
+    assert(map != NULL);
+    assert(path != NULL);
+    // an address hash would mean nothing to the process reading the file
+    assert(map->prehash != NULL);
+    assert(map->encodeKey != NULL && map->encodeValue != NULL);
+    GATHER gather = {NULL, NULL, 0};
+    gather.pairs = malloc(sizeof(void **) * (map->size + 1));
+    gather.hashes = malloc(sizeof(unsigned int) * (map->size + 1));
+    assert(gather.pairs != NULL && gather.hashes != NULL);
+    if (map->old != NULL) map->walkEntries(map, map->old, 0, map->old->capacity, gatherEntry, &gather);
+    map->walkEntries(map, map->table, 0, map->table->capacity, gatherEntry, &gather);
+    assert(gather.count == map->size);
+    // counting sort of the entries by bucket
+    int capacity = map->table->capacity;
+    uint32_t *starts = calloc(capacity + 1, sizeof(uint32_t));
+    int *next = malloc(sizeof(int) * capacity);
+    int *order = malloc(sizeof(int) * (gather.count + 1));
+    SNAPENTRY *entries = calloc(gather.count + 1, sizeof(SNAPENTRY));
+    assert(starts != NULL && next != NULL && order != NULL && entries != NULL);
+    for (int i = 0; i < gather.count; ++i) starts[indexFor(gather.hashes[i], capacity) + 1]++;
+    for (int b = 0; b < capacity; ++b) {
+        starts[b + 1] += starts[b];
+        next[b] = starts[b];
+    }
+    for (int i = 0; i < gather.count; ++i) order[next[indexFor(gather.hashes[i], capacity)]++] = i;
+    SNAPHEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.version = SNAPSHOT_VERSION;
+    header.capacity = capacity;
+    header.size = gather.count;
+    header.starts = sizeof(SNAPHEADER);
+    header.entries = (header.starts + sizeof(uint32_t) * (capacity + 1) + SNAPSHOT_ALIGNMENT - 1)
+                        & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+    char *temporary = malloc(strlen(path) + 5);
+    assert(temporary != NULL);
+    sprintf(temporary, "%s.tmp", path);
+    FILE *fp = fopen(temporary, "wb");
+    bool ok = fp != NULL;
+    // the encoded items go after the entry array, which is written last
+    uint64_t offset = header.entries + sizeof(SNAPENTRY) * gather.count;
+    ok = ok && fseek(fp, (long)offset, SEEK_SET) == 0;
+    unsigned char *buffer = NULL;
+    size_t bufferSize = 0;
+    for (int j = 0; ok && j < gather.count; ++j) {
+        void **pair = gather.pairs[order[j]];
+        SNAPENTRY *entry = &entries[j];
+        entry->hash = gather.hashes[order[j]];
+        entry->key = offset;
+        ok = writeItem(fp, map->encodeKey, pair[0], &buffer, &bufferSize, &offset, &entry->keyLength);
+        entry->hasValue = pair[1] != NULL;
+        if (ok && entry->hasValue) {
+            entry->value = offset;
+            ok = writeItem(fp, map->encodeValue, pair[1], &buffer, &bufferSize, &offset, &entry->valueLength);
+        }
+    }
+    header.length = offset;
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0
+            && fwrite(&header, sizeof(header), 1, fp) == 1
+            && fwrite(starts, sizeof(uint32_t), capacity + 1, fp) == (size_t)capacity + 1
+            && fseek(fp, (long)header.entries, SEEK_SET) == 0
+            && fwrite(entries, sizeof(SNAPENTRY), gather.count, fp) == (size_t)gather.count;
+    if (fp != NULL && fclose(fp) != 0) ok = false;
+    ok = ok && rename(temporary, path) == 0;
+    if (!ok && fp != NULL) remove(temporary);
+    free(temporary);
+    free(buffer);
+    free(entries);
+    free(order);
+    free(next);
+    free(starts);
+    free(gather.hashes);
+    free(gather.pairs);
+    return ok;
+}
+
+bool loadHASHMAP(HASHMAP *map, const char *path) {
+    // Inserts every entry of a saveHASHMAP snapshot into map, decoding keys
+    // and values with the map's codecs and reusing the saved hashes instead
+    // of calling prehash. Returns false if path is not a readable snapshot.
+    assert(map != NULL);
+    assert(path != NULL);
+    assert(map->decodeKey != NULL && map->decodeValue != NULL);
+    HASHMAPVIEW *view = loadHASHMAPview(path, map->prehash, map->encodeKey);
+    if (view == NULL) return false;
+    presizeHASHMAP(map, map->size + view->header->size);
+    for (uint32_t i = 0; i < view->header->size; ++i) {
+        const SNAPENTRY *entry = &view->entries[i];
+        void *key = map->decodeKey(view->base + entry->key, entry->keyLength);
+        void *value = NULL;
+        if (entry->hasValue) value = map->decodeValue(view->base + entry->value, entry->valueLength);
+        void *stored;
+        void **slot = upsertHASHMAP(map, key, entry->hash, &stored);
+        assignEntry(map, slot, stored, key, value);
+    }
+    freeHASHMAPVIEW(view);
+    return true;
+}
+
+bool dumpHASHMAP(HASHMAP *map, int fd) {
+    // Streams the map to fd with its codecs, in blocks of about DUMP_BLOCK
+    // bytes that each carry a CRC-32, so memory use stays bounded however
+    // large the map is. fd may be a pipe or socket. Returns false if a
+    // write fails.
+    assert(map != NULL);
+    assert(fd >= 0);
+    assert(map->encodeKey != NULL && map->encodeValue != NULL);
+    pthread_once(&checksumOnce, buildChecksumTable);
+    DUMPHEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DUMP_MAGIC, sizeof(header.magic));
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.version = DUMP_VERSION;
+    header.entries = map->size;
+    DUMP dump = {map, fd, malloc(DUMP_BLOCK), DUMP_BLOCK, 0, 0, true};
+    assert(dump.block != NULL);
+    dump.ok = writeAll(fd, &header, sizeof(header));
+    if (map->old != NULL) map->walkEntries(map, map->old, 0, map->old->capacity, dumpEntry, &dump);
+    map->walkEntries(map, map->table, 0, map->table->capacity, dumpEntry, &dump);
+    // flush the last records, then the empty block that ends the stream
+    if (dump.records > 0) flushDump(&dump);
+    flushDump(&dump);
+    free(dump.block);
+    return dump.ok;
+}
+
+bool restoreHASHMAP(HASHMAP *map, int fd, THREADPOOL *pool) {
+    // Inserts the entries of a dumpHASHMAP stream read from fd, decoding
+    // them with the map's codecs. The table is presized from the stream
+    // header and each block goes through insertHASHMAPbatch. With a pool of
+    // two or more workers, worker 1 reads, checks and decodes blocks while
+    // worker 0 inserts the ones before. Returns false if the stream is
+    // short or corrupt; the blocks before the bad one stay inserted.
+    assert(map != NULL);
+    assert(fd >= 0);
+    assert(map->decodeKey != NULL && map->decodeValue != NULL);
+    pthread_once(&checksumOnce, buildChecksumTable);
+    DUMPHEADER header;
+    if (!readAll(fd, &header, sizeof(header))
+            || memcmp(header.magic, DUMP_MAGIC, sizeof(header.magic)) != 0
+            || header.byteOrder != SNAPSHOT_BYTE_ORDER
+            || header.version != DUMP_VERSION
+            || header.entries > (uint64_t)INT32_MAX - map->size) {
+        return false;
+    }
+    presizeHASHMAP(map, map->size + (int)header.entries);
+    RESTORE restore;
+    memset(&restore, 0, sizeof(restore));
+    restore.map = map;
+    restore.fd = fd;
+    restore.ok = true;
+    pthread_mutex_init(&restore.lock, NULL);
+    pthread_cond_init(&restore.changed, NULL);
+    if (pool == NULL || sizeTHREADPOOL(pool) < 2) {
+        CHUNK *chunk = &restore.chunks[0];
+        while (readChunk(&restore, chunk) > 0) insertChunk(map, chunk);
+    }
+    else runTHREADPOOL(pool, restoreWorker, &restore);
+    for (int i = 0; i < RESTORE_DEPTH; ++i) {
+        free(restore.chunks[i].keys);
+        free(restore.chunks[i].values);
+    }
+    free(restore.block);
+    pthread_cond_destroy(&restore.changed);
+    pthread_mutex_destroy(&restore.lock);
+    return restore.ok;
+}
+
+HASHMAPVIEW *loadHASHMAPview(const char *path, int (*prehash)(void *),
+        size_t (*encodeKey)(void *, void *, size_t)) {
+    // Maps a saveHASHMAP snapshot read-only and answers lookups from the
+    // mapping itself, so nothing is decoded or copied up front. prehash and
+    // encodeKey must be the ones the saving map used. Returns NULL if path
+    // cannot be mapped or is not a snapshot from a machine of this byte
+    // order, or if any entry refers to bytes outside the file.
+    assert(path != NULL);
+    assert(prehash != NULL && encodeKey != NULL);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SNAPHEADER)) {
+        base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // the mapping outlives the descriptor
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    size_t length = info.st_size;
+    const SNAPHEADER *header = base;
+    uint64_t capacity = header->capacity;
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0
+            && header->byteOrder == SNAPSHOT_BYTE_ORDER
+            && header->version == SNAPSHOT_VERSION
+            && header->length == length
+            // no map can hold more than the largest power of two in an int
+            && capacity > 0 && capacity <= INT_MAX && (capacity & (capacity - 1)) == 0
+            && header->starts % SNAPSHOT_ALIGNMENT == 0
+            && header->entries % SNAPSHOT_ALIGNMENT == 0
+            && validSection(header->starts, capacity + 1, sizeof(uint32_t), length)
+            && validSection(header->entries, header->size, sizeof(SNAPENTRY), length);
+    // every entry must refer to bytes inside the file, so that neither
+    // lookups nor loadHASHMAP need to check again
+    const SNAPENTRY *entries = (const SNAPENTRY *)((const unsigned char *)base + header->entries);
+    for (uint32_t i = 0; valid && i < header->size; ++i) {
+        valid = validEntry(&entries[i], length);
+    }
+    if (!valid) {
+        munmap(base, length);
+        return NULL;
+    }
+    HASHMAPVIEW *view = malloc(sizeof(HASHMAPVIEW));
+    assert(view != NULL);
+    view->base = base;
+    view->length = length;
+    view->header = header;
+    view->starts = (const uint32_t *)(view->base + header->starts);
+    view->entries = entries;
+    view->prehash = prehash;
+    view->encodeKey = encodeKey;
+    return view;
+}
+
+const void *getHASHMAPVIEWvalue(HASHMAPVIEW *view, void *key, size_t *length) {
+    // Returns the encoded value of key inside the mapping, storing its
+    // length in *length unless length is NULL, or returns NULL if key is
+    // absent or its value was NULL. The bytes stay valid until
+    // freeHASHMAPVIEW and are aligned to SNAPSHOT_ALIGNMENT.
+    assert(view != NULL);
+    assert(key != NULL);
+    const SNAPENTRY *entry = findViewEntry(view, key);
+    if (entry == NULL || !entry->hasValue) return NULL;
+    if (length != NULL) *length = entry->valueLength;
+    return view->base + entry->value;
+}
+
+bool containsHASHMAPVIEWkey(HASHMAPVIEW *view, void *key) {
+    assert(view != NULL);
+    assert(key != NULL);
+    return findViewEntry(view, key) != NULL;
+}
+
+int sizeHASHMAPVIEW(HASHMAPVIEW *view) {
+    assert(view != NULL);
+    return view->header->size;
+}
+
+void freeHASHMAPVIEW(HASHMAPVIEW *view) {
+    assert(view != NULL);
+    munmap((void *)view->base, view->length);
+    free(view);
+}
+
 int debugHASHMAP(HASHMAP *map, int level) {
     assert(map !=NULL);
     assert(level >= 0);
+    int oldLevel = map->debugLevel;
     map->debugLevel = level;
-    return debugDA(map->store, level);
+    return oldLevel;
 }
 
 void freeHASHMAP(HASHMAP *map) {
+    freeHASHMAPparallel(map, NULL);
+}
+
+void freeHASHMAPparallel(HASHMAP *map, THREADPOOL *pool) {
+    // Frees the map, running the free callbacks of each slice of the table
+    // on a different worker. A NULL pool runs serially.
     assert(map != NULL);
-    for (int i = 0; i < map->capacity; ++i) {
-        freeSLL(getDA(map->store, i));
-    }
-    freeDA(map->store);
+    releaseTables(map, pool);
+    if (map->hnodes != NULL) freeSLAB(map->hnodes);
     free(map);
 }
 
+HASHMAPTRACER *newHASHMAPTRACER(int capacity) {
+    // Keeps the last capacity events, rounded up to a power of two. Events
+    // are stored as they are, so recording one costs a copy.
+    assert(capacity > 0);
+    HASHMAPTRACER *tracer = malloc(sizeof(HASHMAPTRACER));
+    assert(tracer != NULL);
+    tracer->capacity = 1;
+    while (tracer->capacity < capacity) tracer->capacity *= 2;
+    tracer->events = malloc(sizeof(HASHMAPTRACE) * tracer->capacity);
+    assert(tracer->events != NULL);
+    tracer->count = 0;
+    return tracer;
+}
+
+void recordHASHMAPTRACER(const HASHMAPTRACE *event, void *tracer) {
+    // Usage: setHASHMAPtrace(map, recordHASHMAPTRACER, tracer);
+    HASHMAPTRACER *ring = tracer;
+    assert(event != NULL && ring != NULL);
+    ring->events[ring->count++ & (ring->capacity - 1)] = *event;
+}
+
+int sizeHASHMAPTRACER(HASHMAPTRACER *tracer) {
+    // events held, at most the capacity
+    assert(tracer != NULL);
+    return tracer->count < tracer->capacity ? (int)tracer->count : tracer->capacity;
+}
+
+long countHASHMAPTRACER(HASHMAPTRACER *tracer) {
+    // events recorded since the tracer was made, overwritten ones included
+    assert(tracer != NULL);
+    return tracer->count;
+}
+
+bool getHASHMAPTRACERevent(HASHMAPTRACER *tracer, int index, HASHMAPTRACE *event) {
+    // Copies the index-th held event, oldest first, into event. Returns
+    // false if fewer events are held.
+    assert(tracer != NULL);
+    assert(event != NULL);
+    int size = sizeHASHMAPTRACER(tracer);
+    if (index < 0 || index >= size) return false;
+    *event = tracer->events[(tracer->count - size + index) & (tracer->capacity - 1)];
+    return true;
+}
+
+void displayHASHMAPTRACER(HASHMAPTRACER *tracer, FILE *fp) {
+    // Prints the held events, oldest first, one per line, numbered from the
+    // first event recorded. Keys are shown by address, as they may be gone.
+    assert(tracer != NULL);
+    static const char *names[] = {"probe", "insert", "remove", "resize"};
+    int size = sizeHASHMAPTRACER(tracer);
+    for (int i = 0; i < size; ++i) {
+        HASHMAPTRACE event;
+        getHASHMAPTRACERevent(tracer, i, &event);
+        fprintf(fp, "%ld %s", tracer->count - size + i, names[event.event]);
+        if (event.event == HASHMAP_TRACE_RESIZE) fprintf(fp, " capacity %d\n", event.capacity);
+        else {
+            fprintf(fp, " %p hash %08x index %d/%d", event.key, event.hash,
+                    event.index, event.capacity);
+            if (event.event == HASHMAP_TRACE_PROBE) fprintf(fp, event.found ? " hit" : " miss");
+            fprintf(fp, "\n");
+        }
+    }
+}
+
+void freeHASHMAPTRACER(HASHMAPTRACER *tracer) {
+    assert(tracer != NULL);
+    free(tracer->events);
+    free(tracer);
+}
+
 
 /********** Private Method Definitions **********/
 
 static int thresholdHASHMAP(HASHMAP *map) {
     assert(map != NULL);
-    return map->capacity * map->loadFactor;
+    return map->table->capacity * loadFactorHASHMAP(map);
 }
 
-static int hash(HASHMAP *map, void *key) {
+static double loadFactorHASHMAP(HASHMAP *map) {
     assert(map != NULL);
-    assert(key != NULL);
-    return 13 * map->prehash(key) % map->capacity;
+    if (map->backend != HASHMAP_CHAINED && map->loadFactor > MAX_OPEN_LOAD_FACTOR) {
+        return MAX_OPEN_LOAD_FACTOR;
+    }
+    return map->loadFactor;
+}
+
+static int capacityFor(HASHMAP *map, int entries) {
+    // smallest table that holds entries keys without passing the threshold
+    assert(map != NULL);
+    int capacity = INITIAL_CAPACITY;
+    while (capacity * loadFactorHASHMAP(map) < entries) capacity *= GROWTH_FACTOR;
+    return capacity;
+}
+
+static void presizeHASHMAP(HASHMAP *map, int entries) {
+    // Grows the table in one step so that entries fit without a resize. The
+    // rehash is finished eagerly: a bulk load would otherwise drag it along.
+    assert(map != NULL);
+    int capacity = capacityFor(map, entries);
+    if (capacity <= map->table->capacity) return;
+    resize(map, capacity);
+    finishRehash(map);
+}
+
+static unsigned int hash(HASHMAP *map, void *key) {
+    assert(map != NULL);
+    if (map->prehash != NULL) COUNT(map, prehashes);
+    return hashKey(map, key);
+}
+
+static unsigned int hashKey(HASHMAP *map, void *key) {
+    // hash without counting the prehash call, for pool workers
+    assert(map != NULL);
+    assert(key != NULL);
+    if (map->prehash == NULL) {
+        // hash the address itself, dropping the always-zero alignment bits
+        uint64_t address = (uintptr_t)key;
+        return mix((unsigned int)(address >> 4 ^ address >> 32));
+    }
+    return mix((unsigned int)map->prehash(key));
+}
+
+static unsigned int mix(unsigned int h) {
+    // murmur3 finalizer: every input bit affects every output bit, so weak
+    // prehash functions still spread over the low bits used for indexing.
+    // It is a bijection, so distinct prehash values stay distinct.
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static int indexFor(unsigned int hash, int capacity) {
+    // capacities are powers of two, so masking selects the bucket
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    return hash & (unsigned int)(capacity - 1);
+}
+
+static void countEntry(void *ctx, void **pair, unsigned int hash, int position) {
+    // Tallies one entry for displayHASHMAPdistribution.
+    (void)pair;
+    REPORT *report = ctx;
+    int home = indexFor(hash, report->capacity);
+    report->occupancy[home]++;
+    report->displacement[(position - home) & (report->capacity - 1)]++;
+}
+
+static void measureEntry(void *ctx, void **pair, unsigned int hash, int position) {
+    // Tallies the chain nodes, slots or groups a lookup of one entry examines.
+    (void)pair;
+    SHAPE *shape = ctx;
+    int probe;
+    if (shape->backend == HASHMAP_CHAINED) {
+        // chains are walked in order, so count along the current one
+        shape->depth = position == shape->bucket ? shape->depth + 1 : 1;
+        shape->bucket = position;
+        probe = shape->depth;
+    }
+    else {
+        probe = (position - indexFor(hash, shape->capacity)) & (shape->capacity - 1);
+        if (shape->backend == HASHMAP_SWISS) probe /= GROUP_WIDTH;
+        probe++;
+    }
+    shape->stats->probes[probe < HASHMAP_PROBE_ROWS ? probe - 1 : HASHMAP_PROBE_ROWS - 1]++;
+    if (probe > shape->stats->longestProbe) shape->stats->longestProbe = probe;
+}
+
+static size_t tableBytes(HASHMAP *map, TABLE *table) {
+    // a table's arrays, plus its chained nodes when they come from malloc
+    size_t capacity = table->capacity;
+    size_t bytes = sizeof(TABLE);
+    if (table->buckets != NULL) bytes += capacity * sizeof(HNODE *);
+    if (table->slots != NULL) bytes += capacity * sizeof(SLOT);
+    if (table->ctrl != NULL) bytes += capacity + GROUP_WIDTH;
+    if (map->backend == HASHMAP_CHAINED && map->hnodes == NULL) {
+        bytes += (size_t)table->size * sizeof(HNODE);
+    }
+    return bytes;
+}
+
+#if !defined(HASHMAP_NO_STATS)
+static double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+#endif
+
+static void visitEntry(void *visitor, void **pair, unsigned int hash, int position) {
+    (void)hash;
+    (void)position;
+    VISITOR *v = visitor;
+    v->callback(pair[0], pair[1], v->ctx);
+}
+
+static void displayEntry(HASHMAP *map, void *key, void *value, FILE *fp) {
+    assert(map != NULL);
+    fprintf(fp, "(");
+    // if no display function is provided, print the address
+    if (map->displayKey == NULL) fprintf(fp, "%p", key);
+    else map->displayKey(key, fp);
+    fprintf(fp, " : ");
+    if (map->displayValue == NULL) fprintf(fp, "%p", value);
+    else map->displayValue(value, fp);
+    fprintf(fp, ")");
+}
+
+static void traceEvent(HASHMAP *map, HASHMAPEVENT event, void *key, unsigned int hash, bool found) {
+    // Fills in the table's view of the operation and hands it to the callback.
+    assert(map != NULL);
+    HASHMAPTRACE trace;
+    trace.event = event;
+    trace.key = key;
+    trace.hash = hash;
+    trace.capacity = map->table->capacity;
+    trace.index = key == NULL ? 0 : indexFor(hash, trace.capacity);
+    trace.found = found;
+    map->trace(&trace, map->traceContext);
+}
+
+static void **findHASHMAPentry(HASHMAP *map, void *key, unsigned int hash) {
+    // Returns the address of the value stored for key, looking in the table
+    // being drained as well while a rehash is in progress.
+    assert(map != NULL);
+    void **value = map->findEntry(map, map->table, key, hash);
+    if (value == NULL && map->old != NULL) {
+        value = map->findEntry(map, map->old, key, hash);
+    }
+    COUNT(map, gets);
+    if (value != NULL) COUNT(map, hits);
+    else COUNT(map, misses);
+    TRACE(map, HASHMAP_TRACE_PROBE, key, hash, value != NULL);
+    return value;
+}
+
+static void **upsertHASHMAP(HASHMAP *map, void *key, unsigned int h, void **stored) {
+    // Returns the value slot of key, whose hash is h, adding an entry with a
+    // NULL value if it is absent. *stored is set to the key already held by
+    // the map, or to NULL when a new entry was added.
+    assert(map != NULL);
+    rehashStep(map, REHASH_STEPS);
+    prepareInsert(map);
+    // mid-rehash the key may still sit in the old table; update it there
+    if (map->old != NULL) {
+        void **value = map->findEntry(map, map->old, key, h);
+        if (value != NULL) {
+            *stored = STORED_KEY(value);
+            return value;
+        }
+    }
+    void **value = map->findOrAddEntry(map, map->table, key, h, stored);
+    if (*stored == NULL) {
+        map->size++;
+        COUNT(map, inserts);
+        TRACE(map, HASHMAP_TRACE_INSERT, key, h, false);
+    }
+    return value;
+}
+
+static HNODE *allocHNODE(HASHMAP *map, void *key, void *value, unsigned int hash) {
+    assert(map != NULL);
+    if (map->hnodes == NULL) return newHNODE(key, value, hash);
+    HNODE *node = allocSLAB(map->hnodes);
+    node->key = key;
+    node->value = value;
+    node->next = NULL;
+    node->hash = hash;
+    return node;
+}
+
+static void releaseHNODE(HASHMAP *map, HNODE *node) {
+    assert(map != NULL);
+    if (map->hnodes != NULL) releaseSLAB(map->hnodes, node);
+    else free(node);
+}
+
+static void freeEntry(HASHMAP *map, void *key, void *value) {
+    assert(map != NULL);
+    if (key != NULL && map->freeKey != NULL) map->freeKey(key);
+    if (value != NULL && map->freeValue != NULL) map->freeValue(value);
+}
+
+static void assignEntry(HASHMAP *map, void **slot, void *stored, void *key, void *value) {
+    // Stores value in the slot just upserted for key, for the calls that
+    // take ownership of what they insert: a duplicate key passed in and
+    // the displaced value are freed.
+    assert(map != NULL);
+    if (stored != NULL) {
+        if (stored != key && map->freeKey != NULL) map->freeKey(key);
+        if (*slot != NULL && *slot != value && map->freeValue != NULL) {
+            map->freeValue(*slot);
+        }
+    }
+    *slot = value;
+}
+
+static void freeTable(HASHMAP *map, TABLE *table) {
+    assert(map != NULL);
+    assert(table != NULL);
+    map->freeEntries(map, table, 0, table->capacity);
+    dropTable(table);
+}
+
+static void dropTable(TABLE *table) {
+    // releases a table's arrays once its entries are gone; the backends
+    // leave the arrays they do not use NULL
+    free(table->buckets);
+    free(table->slots);
+    free(table->ctrl);
+    free(table);
+}
+
+static void prepareInsert(HASHMAP *map) {
+    // Makes room in the current table for one more entry.
+    assert(map != NULL);
+    int threshold = thresholdHASHMAP(map);
+    // grow the table if the size of the map exceeds the calculated threshold
+    if (map->size > threshold) {
+        resize(map, map->table->capacity * GROWTH_FACTOR);
+    }
+    // deleted slots still lengthen probes, so rebuild once they pile up
+    else if (map->table->size + map->table->tombstones > threshold) {
+        resize(map, map->table->capacity);
+    }
+}
+
+static void resize(HASHMAP *map, int newCapacity) {
+    // Starts an incremental rehash into a table of newCapacity buckets. The
+    // current table becomes the old table and is drained by rehashStep.
+    assert(map != NULL);
+    assert(newCapacity > 0);
+    // only one rehash may be in flight; settle the previous one first
+    finishRehash(map);
+    START_TIMER(start);
+    map->old = map->table;
+    map->rehashIndex = 0;
+    map->table = map->newTable(map, newCapacity);
+    COUNT(map, resizes);
+    STOP_TIMER(map, resizeSeconds, start);
+    TRACE(map, HASHMAP_TRACE_RESIZE, NULL, 0, false);
+}
+
+static void rehashStep(HASHMAP *map, int steps) {
+    // Moves up to steps buckets from the old table into the current table.
+    assert(map != NULL);
+    if (map->old == NULL) return;
+    COUNT(map, rehashSteps);
+    while (steps-- > 0 && map->rehashIndex < map->old->capacity) {
+        map->migrateBucket(map, map->old, map->rehashIndex, map->table);
+        map->rehashIndex++;
+    }
+    if (map->rehashIndex == map->old->capacity) {
+        // every bucket has been migrated, release the old table
+        freeTable(map, map->old);
+        map->old = NULL;
+        map->rehashIndex = 0;
+    }
+}
+
+static void finishRehash(HASHMAP *map) {
+    // The eager migration is timed for statsHASHMAP; the few buckets moved
+    // per operation are only counted, as two clock reads would cost more.
+    assert(map != NULL);
+    if (map->old != NULL) {
+        START_TIMER(start);
+        rehashStep(map, map->old->capacity - map->rehashIndex);
+        STOP_TIMER(map, resizeSeconds, start);
+    }
+}
+
+static int sliceStart(int capacity, int worker, int workers) {
+    // First slot of worker's share of a table. Shares are whole groups, so
+    // a HASHMAP_SWISS group load that stays inside a share reads nothing
+    // another worker writes.
+    assert(capacity >= GROUP_WIDTH);
+    long long groups = capacity / GROUP_WIDTH;
+    return (int)((groups * worker + workers - 1) / workers) * GROUP_WIDTH;
+}
+
+static int sliceOwner(int capacity, int index, int workers) {
+    // the worker whose share, as given by sliceStart, holds slot index
+    long long groups = capacity / GROUP_WIDTH;
+    return (int)(index / GROUP_WIDTH * (long long)workers / groups);
+}
+
+static void runJob(THREADPOOL *pool, void (*task)(void *, int, int), void *job) {
+    if (pool == NULL) task(job, 0, 1);
+    else runTHREADPOOL(pool, task, job);
+}
+
+static void sweepTable(HASHMAP *map, TABLE *table, VISITOR *visitor, THREADPOOL *pool) {
+    // Visits or frees every entry of table, splitting it across the pool.
+    assert(map != NULL);
+    assert(table != NULL);
+    SWEEP sweep = {map, table, visitor};
+    runJob(table->capacity < PARALLEL_GRAIN ? NULL : pool, sweepSlice, &sweep);
+}
+
+static void sweepSlice(void *job, int worker, int workers) {
+    SWEEP *sweep = job;
+    HASHMAP *map = sweep->map;
+    TABLE *table = sweep->table;
+    int from = sliceStart(table->capacity, worker, workers);
+    int to = sliceStart(table->capacity, worker + 1, workers);
+    if (sweep->visitor != NULL) map->walkEntries(map, table, from, to, visitEntry, sweep->visitor);
+    else map->freeEntries(map, table, from, to);
+}
+
+static void releaseTables(HASHMAP *map, THREADPOOL *pool) {
+    // Frees the entries and arrays of the table and of any table still
+    // being drained, leaving the map without one.
+    assert(map != NULL);
+    sweepTable(map, map->table, NULL, pool);
+    dropTable(map->table);
+    map->table = NULL;
+    if (map->old != NULL) {
+        sweepTable(map, map->old, NULL, pool);
+        dropTable(map->old);
+        map->old = NULL;
+        map->rehashIndex = 0;
+    }
+}
+
+static void hashSlice(void *job, int worker, int workers) {
+    BUILD *build = job;
+    int from = (int)((long long)build->count * worker / workers);
+    int to = (int)((long long)build->count * (worker + 1) / workers);
+    for (int i = from; i < to; ++i) {
+        assert(build->keys[i] != NULL);
+        build->hashes[i] = hashKey(build->map, build->keys[i]);
+    }
+}
+
+static void gatherEntry(void *ctx, void **pair, unsigned int hash, int position) {
+    (void)position;
+    GATHER *gather = ctx;
+    gather->pairs[gather->count] = pair;
+    gather->hashes[gather->count] = hash;
+    gather->count++;
+}
+
+static bool writeItem(FILE *fp, size_t (*encode)(void *, void *, size_t), void *item,
+        unsigned char **buffer, size_t *bufferSize, uint64_t *offset, uint32_t *length) {
+    // Appends item's encoding to fp at *offset, padded to the next
+    // SNAPSHOT_ALIGNMENT boundary, growing the shared scratch buffer when
+    // the encoding does not fit.
+    static const unsigned char padding[SNAPSHOT_ALIGNMENT];
+    size_t size = encode(item, *buffer, *bufferSize);
+    if (size > *bufferSize) {
+        *bufferSize = size * 2;
+        *buffer = realloc(*buffer, *bufferSize);
+        assert(*buffer != NULL);
+        size = encode(item, *buffer, *bufferSize);
+    }
+    assert(size <= UINT32_MAX);
+    *length = size;
+    *offset += size;
+    size_t pad = (SNAPSHOT_ALIGNMENT - *offset % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT;
+    *offset += pad;
+    if (size > 0 && fwrite(*buffer, 1, size, fp) != size) return false;
+    return fwrite(padding, 1, pad, fp) == pad;
+}
+
+static bool validSection(uint64_t offset, uint64_t count, size_t size, size_t length) {
+    // whether count items of size bytes starting at offset lie within the
+    // first length bytes of the file, without overflowing on a bad offset
+    return offset <= length && count <= (length - offset) / size;
+}
+
+static bool validEntry(const SNAPENTRY *entry, size_t length) {
+    // whether the encoded key, and the value if there is one, lie within
+    // the first length bytes of the file
+    return entry->keyLength <= length && entry->key <= length - entry->keyLength
+            && (!entry->hasValue || (entry->valueLength <= length
+                    && entry->value <= length - entry->valueLength));
+}
+
+static const SNAPENTRY *findViewEntry(HASHMAPVIEW *view, void *key) {
+    // Looks key up in its bucket, comparing the cached hash, then the
+    // encoded bytes. loadHASHMAPview has checked every entry's references.
+    unsigned int h = mix((unsigned int)view->prehash(key));
+    unsigned char local[PROBE_BUFFER];
+    unsigned char *probe = local;
+    size_t size = view->encodeKey(key, local, sizeof(local));
+    if (size > sizeof(local)) {
+        probe = malloc(size);
+        assert(probe != NULL);
+        view->encodeKey(key, probe, size);
+    }
+    uint32_t b = indexFor(h, view->header->capacity);
+    uint32_t end = view->starts[b + 1];
+    if (end > view->header->size) end = view->header->size;
+    const SNAPENTRY *found = NULL;
+    for (uint32_t i = view->starts[b]; i < end && found == NULL; ++i) {
+        const SNAPENTRY *entry = &view->entries[i];
+        if (entry->hash == h && entry->keyLength == size
+                && memcmp(view->base + entry->key, probe, size) == 0) {
+            found = entry;
+        }
+    }
+    if (probe != local) free(probe);
+    return found;
+}
+
+static void buildChecksumTable(void) {
+    // the reflected CRC-32 polynomial used by zlib and Ethernet
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; ++bit) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        checksumTable[i] = c;
+    }
+}
+
+static uint32_t checksum(const unsigned char *bytes, size_t length) {
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < length; ++i) c = checksumTable[(c ^ bytes[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+static bool writeAll(int fd, const void *bytes, size_t length) {
+    // write, resuming after short writes and signals
+    const unsigned char *p = bytes;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *bytes, size_t length) {
+    // read exactly length bytes; end of file before then is a failure
+    unsigned char *p = bytes;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+static void dumpEntry(void *ctx, void **pair, unsigned int hash, int position) {
+    // Appends one record to the block, encoding straight into its free
+    // space. A record that does not fit first flushes the block, then grows
+    // it if the record alone is larger, and is encoded again.
+    (void)hash;
+    (void)position;
+    DUMP *dump = ctx;
+    HASHMAP *map = dump->map;
+    if (!dump->ok) return;
+    for (;;) {
+        size_t room = dump->size - dump->used;
+        if (room < 2 * sizeof(uint32_t)) {
+            if (!flushDump(dump)) return;
+            continue;
+        }
+        unsigned char *record = dump->block + dump->used;
+        unsigned char *end = dump->block + dump->size;
+        unsigned char *key = record + 2 * sizeof(uint32_t);
+        size_t keyLength = map->encodeKey(pair[0], key, end - key);
+        unsigned char *value = keyLength <= (size_t)(end - key) ? key + keyLength : end;
+        size_t valueLength = pair[1] == NULL ? 0 : map->encodeValue(pair[1], value, end - value);
+        size_t needed = 2 * sizeof(uint32_t) + keyLength + valueLength;
+        assert(keyLength < UINT32_MAX && valueLength < UINT32_MAX);
+        if (needed <= room) {
+            uint32_t lengths[2] = {keyLength, pair[1] == NULL ? DUMP_NULL_VALUE : valueLength};
+            memcpy(record, lengths, sizeof(lengths));
+            dump->used += needed;
+            dump->records++;
+            return;
+        }
+        if (dump->records > 0) {
+            if (!flushDump(dump)) return;
+        }
+        else {
+            dump->size = needed;
+            dump->block = realloc(dump->block, dump->size);
+            assert(dump->block != NULL);
+        }
+    }
+}
+
+static bool flushDump(DUMP *dump) {
+    // writes the block gathered so far and starts a new one
+    DUMPBLOCK block = {dump->used, dump->records, checksum(dump->block, dump->used)};
+    dump->ok = dump->ok && writeAll(dump->fd, &block, sizeof(block))
+            && writeAll(dump->fd, dump->block, dump->used);
+    dump->used = 0;
+    dump->records = 0;
+    return dump->ok;
+}
+
+static int readChunk(RESTORE *restore, CHUNK *chunk) {
+    // Reads, checks and decodes the next block into chunk. Returns 1 for a
+    // block, 0 at the end of the stream and -1 if it is short or corrupt,
+    // in which case restore->ok is cleared.
+    HASHMAP *map = restore->map;
+    DUMPBLOCK block;
+    chunk->count = 0;
+    if (!readAll(restore->fd, &block, sizeof(block)) || block.length > DUMP_MAX_BLOCK
+            || block.records > block.length / (2 * sizeof(uint32_t))) {
+        restore->ok = false;
+        return -1;
+    }
+    if (block.records == 0) {
+        // the end marker is the only block without records
+        if (block.length == 0) return 0;
+        restore->ok = false;
+        return -1;
+    }
+    if (block.length > restore->size) {
+        restore->size = block.length;
+        restore->block = realloc(restore->block, restore->size);
+        assert(restore->block != NULL);
+    }
+    if (!readAll(restore->fd, restore->block, block.length)
+            || checksum(restore->block, block.length) != block.checksum) {
+        restore->ok = false;
+        return -1;
+    }
+    if ((int)block.records > chunk->capacity) {
+        chunk->capacity = block.records;
+        chunk->keys = realloc(chunk->keys, sizeof(void *) * chunk->capacity);
+        chunk->values = realloc(chunk->values, sizeof(void *) * chunk->capacity);
+        assert(chunk->keys != NULL && chunk->values != NULL);
+    }
+    // the checksum matched, but the lengths are still checked against the
+    // payload in case the writer was broken
+    size_t at = 0;
+    for (uint32_t i = 0; i < block.records; ++i) {
+        uint32_t lengths[2];
+        if (block.length - at < sizeof(lengths)) break;
+        memcpy(lengths, restore->block + at, sizeof(lengths));
+        at += sizeof(lengths);
+        size_t valueLength = lengths[1] == DUMP_NULL_VALUE ? 0 : lengths[1];
+        if (lengths[0] > block.length - at || valueLength > block.length - at - lengths[0]) break;
+        chunk->keys[i] = map->decodeKey(restore->block + at, lengths[0]);
+        at += lengths[0];
+        chunk->values[i] = NULL;
+        if (lengths[1] != DUMP_NULL_VALUE) {
+            chunk->values[i] = map->decodeValue(restore->block + at, valueLength);
+        }
+        at += valueLength;
+        chunk->count++;
+    }
+    if (chunk->count < (int)block.records || at != block.length) {
+        discardChunk(map, chunk);
+        restore->ok = false;
+        return -1;
+    }
+    return 1;
+}
+
+static void insertChunk(HASHMAP *map, CHUNK *chunk) {
+    insertHASHMAPbatch(map, chunk->keys, chunk->values, chunk->count);
+    chunk->count = 0;
+}
+
+static void discardChunk(HASHMAP *map, CHUNK *chunk) {
+    // frees decoded items that will never be inserted
+    for (int i = 0; i < chunk->count; ++i) freeEntry(map, chunk->keys[i], chunk->values[i]);
+    chunk->count = 0;
+}
+
+static void restoreWorker(void *ctx, int worker, int workers) {
+    // Worker 1 decodes blocks into the ring of chunks and worker 0 inserts
+    // them in order; the ring bounds how far the reader runs ahead.
+    (void)workers;
+    RESTORE *restore = ctx;
+    if (worker == 1) {
+        for (;;) {
+            pthread_mutex_lock(&restore->lock);
+            while (restore->produced - restore->consumed == RESTORE_DEPTH) {
+                pthread_cond_wait(&restore->changed, &restore->lock);
+            }
+            pthread_mutex_unlock(&restore->lock);
+            CHUNK *chunk = &restore->chunks[restore->produced % RESTORE_DEPTH];
+            int status = readChunk(restore, chunk);
+            pthread_mutex_lock(&restore->lock);
+            if (status > 0) restore->produced++;
+            else restore->finished = true;
+            pthread_cond_broadcast(&restore->changed);
+            pthread_mutex_unlock(&restore->lock);
+            if (status <= 0) return;
+        }
+    }
+    if (worker != 0) return;
+    for (;;) {
+        pthread_mutex_lock(&restore->lock);
+        while (restore->consumed == restore->produced && !restore->finished) {
+            pthread_cond_wait(&restore->changed, &restore->lock);
+        }
+        bool more = restore->consumed < restore->produced;
+        pthread_mutex_unlock(&restore->lock);
+        if (!more) return;
+        insertChunk(restore->map, &restore->chunks[restore->consumed % RESTORE_DEPTH]);
+        pthread_mutex_lock(&restore->lock);
+        restore->consumed++;
+        pthread_cond_broadcast(&restore->changed);
+        pthread_mutex_unlock(&restore->lock);
+    }
+}
+
+static void claimSlice(void *job, int worker, int workers) {
+    // Adds the keys owned by worker without leaving its share of the table.
+    // Keys whose probe would leave it are moved to the front of the
+    // worker's part of order for the serial pass.
+    BUILD *build = job;
+    HASHMAP *map = build->map;
+    TABLE *table = map->table;
+    int limit = sliceStart(table->capacity, worker + 1, workers);
+    int *mine = build->order + build->starts[worker];
+    int n = build->starts[worker + 1] - build->starts[worker];
+    int added = 0;
+    int deferred = 0;
+    for (int j = 0; j < n; ++j) {
+        int i = mine[j];
+        void **spare = build->spares == NULL ? NULL : &build->spares[i];
+        void *stored;
+        void **slot = map->claimEntry(map, table, build->keys[i], build->hashes[i], limit, spare, &stored);
+        if (slot == NULL) {
+            mine[deferred++] = i;
+            continue;
+        }
+        if (stored == NULL) added++;
+        assignEntry(map, slot, stored, build->keys[i], build->values[i]);
+    }
+    build->added[worker] = added;
+    build->deferred[worker] = deferred;
+}
+
+
+/********** HASHMAP_CHAINED Backend **********/
+
+static TABLE *newChainedTable(HASHMAP *map, int capacity) {
+    (void)map;
+    TABLE *table = malloc(sizeof(TABLE));
+    assert(table != NULL);
+    table->capacity = capacity;
+    table->size = 0;
+    table->tombstones = 0;
+    table->ctrl = NULL;
+    table->slots = NULL;
+    table->buckets = calloc(capacity, sizeof(HNODE *));
+    assert(table->buckets != NULL);
+    return table;
+}
+
+static void freeChainedEntries(HASHMAP *map, TABLE *table, int from, int to) {
+    assert(map != NULL);
+    assert(table != NULL);
+    // Pooled nodes are never released one by one: non-empty tables are only
+    // freed by clearHASHMAP and freeHASHMAP, which drop the slab. Without
+    // payload callbacks they need no walk at all.
+    if (map->hnodes != NULL && map->freeKey == NULL && map->freeValue == NULL) return;
+    for (int i = from; i < to; ++i) {
+        HNODE *node = table->buckets[i];
+        while (node != NULL) {
+            HNODE *next = node->next;
+            freeEntry(map, node->key, node->value);
+            if (map->hnodes == NULL) free(node);
+            node = next;
+        }
+    }
+}
+
+static void **findChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash) {
+    assert(map != NULL);
+    assert(table != NULL);
+    HNODE *node = table->buckets[indexFor(hash, table->capacity)];
+    for (; node != NULL; node = node->next) {
+        if (node->hash == hash && KEYS_EQUAL(map, node->key, key)) {
+            return &node->value;
+        }
+    }
+    return NULL;
+}
+
+static void **findOrAddChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **stored) {
+    assert(map != NULL);
+    assert(table != NULL);
+    HNODE **bucket = &table->buckets[indexFor(hash, table->capacity)];
+    for (HNODE *node = *bucket; node != NULL; node = node->next) {
+        if (node->hash == hash && KEYS_EQUAL(map, node->key, key)) {
+            *stored = node->key;
+            return &node->value;
+        }
+    }
+    // not found: push a new HNODE onto the bucket already in hand
+    HNODE *node = allocHNODE(map, key, NULL, hash);
+    node->next = *bucket;
+    *bucket = node;
+    table->size++;
+    *stored = NULL;
+    return &node->value;
+}
+
+static void **claimChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, int limit, void **spare, void **stored) {
+    // findOrAddChainedEntry for buildHASHMAPparallel: table->size is left to
+    // the caller, and a new node comes from *spare when the map is pooled.
+    // A chain never leaves its home bucket, so limit is never reached.
+    assert(map != NULL);
+    assert(table != NULL);
+    (void)limit;
+    HNODE **bucket = &table->buckets[indexFor(hash, table->capacity)];
+    for (HNODE *node = *bucket; node != NULL; node = node->next) {
+        if (node->hash == hash && SAME_KEY(map, node->key, key)) {
+            *stored = node->key;
+            return &node->value;
+        }
+    }
+    HNODE *node;
+    if (spare == NULL) node = newHNODE(key, NULL, hash);
+    else {
+        node = *spare;
+        *spare = NULL;
+        node->key = key;
+        node->value = NULL;
+        node->hash = hash;
+    }
+    node->next = *bucket;
+    *bucket = node;
+    *stored = NULL;
+    return &node->value;
+}
+
+static void *removeChainedEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **value) {
+    assert(map != NULL);
+    assert(table != NULL);
+    // walk the links themselves so the match can be unlinked in place
+    HNODE **link = &table->buckets[indexFor(hash, table->capacity)];
+    for (; *link != NULL; link = &(*link)->next) {
+        HNODE *node = *link;
+        if (node->hash == hash && KEYS_EQUAL(map, node->key, key)) {
+            *link = node->next;
+            void *result = node->key;
+            *value = node->value;
+            releaseHNODE(map, node);
+            table->size--;
+            return result;
+        }
+    }
+    return NULL;
+}
+
+static void migrateChainedBucket(HASHMAP *map, TABLE *from, int index, TABLE *to) {
+    (void)map;
+    HNODE *node = from->buckets[index];
+    from->buckets[index] = NULL;
+    while (node != NULL) {
+        HNODE *next = node->next;
+        // reuse the cached hash instead of calling prehash again
+        HNODE **bucket = &to->buckets[indexFor(node->hash, to->capacity)];
+        node->next = *bucket;
+        *bucket = node;
+        from->size--;
+        to->size++;
+        node = next;
+    }
+}
+
+static void displayChainedBucket(HASHMAP *map, TABLE *table, int index, FILE *fp) {
+    assert(map != NULL);
+    fprintf(fp, "{");
+    for (HNODE *node = table->buckets[index]; node != NULL; node = node->next) {
+        displayEntry(map, node->key, node->value, fp);
+        if (node->next != NULL) fprintf(fp, ",");
+    }
+    fprintf(fp, "}");
+}
+
+static void walkChainedEntries(HASHMAP *map, TABLE *table, int from, int to, void (*visit)(void *, void **, unsigned int, int), void *ctx) {
+    (void)map;
+    for (int i = from; i < to; ++i) {
+        for (HNODE *node = table->buckets[i]; node != NULL; node = node->next) {
+            visit(ctx, &node->key, node->hash, i);
+        }
+    }
+}
+
+static void prefetchChainedEntry(HASHMAP *map, TABLE *table, unsigned int hash, int stage) {
+    // stage 0 fetches the bucket head pointer, stage 1 the first node and
+    // stage 2 its key, if the cached hash says the comparator will need it
+    (void)map;
+    HNODE **bucket = &table->buckets[indexFor(hash, table->capacity)];
+    if (stage == 0) PREFETCH(bucket);
+    else if (*bucket == NULL) return;
+    else if (stage == 1) PREFETCH(*bucket);
+    else if ((*bucket)->hash == hash) PREFETCH((*bucket)->key);
+}
+
+static bool stepChainedEntry(HASHMAP *map, HASHMAPITER *iter) {
+    // iter->link is the pointer that leads to the current node, so the node
+    // can be unlinked without walking its bucket again
+    TABLE *table = map->table;
+    HNODE **link = iter->link;
+    if (link != NULL) {
+        // after a removal *link already holds the following node
+        if (!iter->removed) link = &(*link)->next;
+        iter->removed = false;
+        if (*link != NULL) {
+            iter->link = link;
+            iter->pair = &(*link)->key;
+            return true;
+        }
+    }
+    for (int i = iter->index + 1; i < table->capacity; ++i) {
+        if (table->buckets[i] != NULL) {
+            iter->index = i;
+            iter->link = &table->buckets[i];
+            iter->pair = &table->buckets[i]->key;
+            return true;
+        }
+    }
+    iter->index = table->capacity;
+    iter->pair = NULL;
+    return false;
+}
+
+static void *removeChainedCurrent(HASHMAP *map, HASHMAPITER *iter, void **value) {
+    HNODE **link = iter->link;
+    HNODE *node = *link;
+    *link = node->next;
+    void *key = node->key;
+    *value = node->value;
+    releaseHNODE(map, node);
+    map->table->size--;
+    return key;
+}
+
+
+/********** HASHMAP_LINEAR_PROBING Backend **********/
+
+static TABLE *newLinearTable(HASHMAP *map, int capacity) {
+    (void)map;
+    // probing wraps with a mask, so capacities must be powers of two
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    TABLE *table = malloc(sizeof(TABLE));
+    assert(table != NULL);
+    table->capacity = capacity;
+    table->size = 0;
+    table->tombstones = 0;
+    table->ctrl = NULL;
+    table->buckets = NULL;
+    table->slots = calloc(capacity, sizeof(SLOT));
+    assert(table->slots != NULL);
+    return table;
+}
+
+static void freeLinearEntries(HASHMAP *map, TABLE *table, int from, int to) {
+    assert(map != NULL);
+    assert(table != NULL);
+    if (map->freeKey == NULL && map->freeValue == NULL) return;
+    for (int i = from; i < to; ++i) {
+        SLOT *slot = &table->slots[i];
+        if (slot->key == NULL || slot->key == TOMBSTONE) continue;
+        freeEntry(map, slot->key, slot->value);
+    }
+}
+
+static void **findLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash) {
+    assert(map != NULL);
+    assert(table != NULL);
+    int mask = table->capacity - 1;
+    // an empty slot ends the probe sequence; tombstones do not
+    for (int i = indexFor(hash, table->capacity); table->slots[i].key != NULL; i = (i + 1) & mask) {
+        SLOT *slot = &table->slots[i];
+        if (slot->key != TOMBSTONE && slot->hash == hash
+                && KEYS_EQUAL(map, slot->key, key)) {
+            return &slot->value;
+        }
+    }
+    return NULL;
+}
+
+static void **findOrAddLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **stored) {
+    assert(map != NULL);
+    assert(table != NULL);
+    int mask = table->capacity - 1;
+    int reuse = -1;     // first tombstone passed, where a new entry would go
+    int i = indexFor(hash, table->capacity);
+    for (; table->slots[i].key != NULL; i = (i + 1) & mask) {
+        SLOT *slot = &table->slots[i];
+        if (slot->key == TOMBSTONE) {
+            if (reuse < 0) reuse = i;
+        }
+        else if (slot->hash == hash && KEYS_EQUAL(map, slot->key, key)) {
+            *stored = slot->key;
+            return &slot->value;
+        }
+    }
+    if (reuse >= 0) {
+        i = reuse;
+        table->tombstones--;
+    }
+    table->slots[i].hash = hash;
+    table->slots[i].key = key;
+    table->slots[i].value = NULL;
+    table->size++;
+    *stored = NULL;
+    return &table->slots[i].value;
+}
+
+static void **claimLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, int limit, void **spare, void **stored) {
+    // findOrAddLinearEntry for buildHASHMAPparallel, on a table without
+    // tombstones. table->size is left to the caller. Returns NULL instead of
+    // probing slot limit or beyond.
+    assert(map != NULL);
+    assert(table != NULL);
+    (void)spare;
+    for (int i = indexFor(hash, table->capacity); i < limit; ++i) {
+        SLOT *slot = &table->slots[i];
+        if (slot->key == NULL) {
+            slot->hash = hash;
+            slot->key = key;
+            slot->value = NULL;
+            *stored = NULL;
+            return &slot->value;
+        }
+        if (slot->hash == hash && SAME_KEY(map, slot->key, key)) {
+            *stored = slot->key;
+            return &slot->value;
+        }
+    }
+    return NULL;
+}
+
+static void addLinearEntry(HASHMAP *map, TABLE *table, void *key, void *value, unsigned int hash) {
+    (void)map;
+    assert(table != NULL);
+    int mask = table->capacity - 1;
+    int i = indexFor(hash, table->capacity);
+    // reuse the first empty or deleted slot in the probe sequence
+    while (table->slots[i].key != NULL && table->slots[i].key != TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (table->slots[i].key == TOMBSTONE) table->tombstones--;
+    table->slots[i].hash = hash;
+    table->slots[i].key = key;
+    table->slots[i].value = value;
+    table->size++;
+}
+
+static void *removeLinearEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **value) {
+    assert(map != NULL);
+    assert(table != NULL);
+    void **found = findLinearEntry(map, table, key, hash);
+    if (found == NULL) return NULL;
+    SLOT *slot = (SLOT *)((char *)found - offsetof(SLOT, value));
+    void *result = slot->key;
+    *value = slot->value;
+    // leave a tombstone so later entries in the probe sequence stay reachable
+    slot->key = TOMBSTONE;
+    slot->value = NULL;
+    table->size--;
+    table->tombstones++;
+    return result;
+}
+
+static void migrateLinearBucket(HASHMAP *map, TABLE *from, int index, TABLE *to) {
+    assert(map != NULL);
+    SLOT *slot = &from->slots[index];
+    if (slot->key == NULL || slot->key == TOMBSTONE) return;
+    addLinearEntry(map, to, slot->key, slot->value, slot->hash);
+    // tombstone rather than empty the slot, since the old table is still probed
+    slot->key = TOMBSTONE;
+    slot->value = NULL;
+    from->size--;
+    from->tombstones++;
+}
+
+static void displayLinearBucket(HASHMAP *map, TABLE *table, int index, FILE *fp) {
+    assert(map != NULL);
+    SLOT *slot = &table->slots[index];
+    fprintf(fp, "{");
+    if (slot->key == TOMBSTONE) {
+        if (map->debugLevel > 0) fprintf(fp, "X");
+    }
+    else if (slot->key != NULL) displayEntry(map, slot->key, slot->value, fp);
+    fprintf(fp, "}");
+}
+
+static void walkLinearEntries(HASHMAP *map, TABLE *table, int from, int to, void (*visit)(void *, void **, unsigned int, int), void *ctx) {
+    (void)map;
+    for (int i = from; i < to; ++i) {
+        SLOT *slot = &table->slots[i];
+        if (slot->key != NULL && slot->key != TOMBSTONE) {
+            visit(ctx, &slot->key, slot->hash, i);
+        }
+    }
+}
+
+static void prefetchLinearEntry(HASHMAP *map, TABLE *table, unsigned int hash, int stage) {
+    // stage 0 fetches the home slot and stage 1 the key it holds, if the
+    // cached hash says the comparator will need it
+    (void)map;
+    SLOT *slot = &table->slots[indexFor(hash, table->capacity)];
+    if (stage == 0) PREFETCH(slot);
+    else if (stage == 1 && slot->key != NULL && slot->key != TOMBSTONE
+            && slot->hash == hash) {
+        PREFETCH(slot->key);
+    }
+}
+
+static bool stepLinearEntry(HASHMAP *map, HASHMAPITER *iter) {
+    TABLE *table = map->table;
+    iter->removed = false;
+    for (int i = iter->index + 1; i < table->capacity; ++i) {
+        SLOT *slot = &table->slots[i];
+        if (slot->key != NULL && slot->key != TOMBSTONE) {
+            iter->index = i;
+            iter->pair = &slot->key;
+            return true;
+        }
+    }
+    iter->index = table->capacity;
+    iter->pair = NULL;
+    return false;
+}
+
+static void *removeLinearCurrent(HASHMAP *map, HASHMAPITER *iter, void **value) {
+    // a tombstone keeps the probe sequences through this slot intact
+    TABLE *table = map->table;
+    SLOT *slot = &table->slots[iter->index];
+    void *key = slot->key;
+    *value = slot->value;
+    slot->key = TOMBSTONE;
+    slot->value = NULL;
+    table->size--;
+    table->tombstones++;
+    return key;
+}
+
+
+/********** HASHMAP_SWISS Backend **********/
+
+static void detectSIMD(void) {
+    // Picks the group match once per process. Builds without SSE2, or CPUs
+    // that lack it, use the portable byte loop instead.
+    if (haveSSE2 >= 0) return;
+#if defined(HASHMAP_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    haveSSE2 = __builtin_cpu_supports("sse2") != 0;
+#else
+    haveSSE2 = 0;
+#endif
+}
+
+static unsigned int matchControl(const unsigned char *group, unsigned char control) {
+    // bit i of the result is set when group[i] == control
+#if defined(HASHMAP_SSE2)
+    if (haveSSE2) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)group);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)control)));
+    }
+#endif
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; ++i) {
+        if (group[i] == control) mask |= 1u << i;
+    }
+    return mask;
+}
+
+static unsigned int matchFree(const unsigned char *group) {
+    // empty and deleted control bytes are the ones with the high bit set
+#if defined(HASHMAP_SSE2)
+    if (haveSSE2) return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#endif
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; ++i) {
+        if (group[i] & 0x80) mask |= 1u << i;
+    }
+    return mask;
+}
+
+static int lowestBit(unsigned int mask) {
+    assert(mask != 0);
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static void setControl(TABLE *table, int index, unsigned char control) {
+    // a group load may start anywhere, so the first group is mirrored past
+    // the end of the array instead of wrapping
+    table->ctrl[index] = control;
+    if (index < GROUP_WIDTH) table->ctrl[table->capacity + index] = control;
+}
+
+static TABLE *newSwissTable(HASHMAP *map, int capacity) {
+    (void)map;
+    assert(capacity >= GROUP_WIDTH && (capacity & (capacity - 1)) == 0);
+    TABLE *table = malloc(sizeof(TABLE));
+    assert(table != NULL);
+    table->capacity = capacity;
+    table->size = 0;
+    table->tombstones = 0;
+    table->buckets = NULL;
+    table->slots = malloc(sizeof(SLOT) * capacity);
+    table->ctrl = malloc(capacity + GROUP_WIDTH);
+    assert(table->slots != NULL && table->ctrl != NULL);
+    memset(table->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+    return table;
+}
+
+static void freeSwissEntries(HASHMAP *map, TABLE *table, int from, int to) {
+    assert(map != NULL);
+    assert(table != NULL);
+    if (map->freeKey == NULL && map->freeValue == NULL) return;
+    for (int i = from; i < to; ++i) {
+        if ((table->ctrl[i] & 0x80) == 0) {
+            freeEntry(map, table->slots[i].key, table->slots[i].value);
+        }
+    }
+}
+
+static void **findSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash) {
+    assert(map != NULL);
+    assert(table != NULL);
+    int mask = table->capacity - 1;
+    unsigned char tag = TAG(hash);
+    // a group holding an empty slot ends the probe sequence
+    for (int pos = indexFor(hash, table->capacity); ; pos = (pos + GROUP_WIDTH) & mask) {
+        const unsigned char *group = table->ctrl + pos;
+        // only slots whose tag matches reach the comparator
+        for (unsigned int m = matchControl(group, tag); m != 0; m &= m - 1) {
+            SLOT *slot = &table->slots[(pos + lowestBit(m)) & mask];
+            if (slot->hash == hash && KEYS_EQUAL(map, slot->key, key)) {
+                return &slot->value;
+            }
+        }
+        if (matchControl(group, CTRL_EMPTY) != 0) return NULL;
+    }
+}
+
+static void **findOrAddSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **stored) {
+    assert(map != NULL);
+    assert(table != NULL);
+    int mask = table->capacity - 1;
+    unsigned char tag = TAG(hash);
+    int target = -1;    // first free slot passed, where a new entry would go
+    for (int pos = indexFor(hash, table->capacity); ; pos = (pos + GROUP_WIDTH) & mask) {
+        const unsigned char *group = table->ctrl + pos;
+        for (unsigned int m = matchControl(group, tag); m != 0; m &= m - 1) {
+            SLOT *slot = &table->slots[(pos + lowestBit(m)) & mask];
+            if (slot->hash == hash && KEYS_EQUAL(map, slot->key, key)) {
+                *stored = slot->key;
+                return &slot->value;
+            }
+        }
+        unsigned int vacant = matchFree(group);
+        if (target < 0 && vacant != 0) target = (pos + lowestBit(vacant)) & mask;
+        if (matchControl(group, CTRL_EMPTY) != 0) break;
+    }
+    if (table->ctrl[target] == CTRL_DELETED) table->tombstones--;
+    setControl(table, target, tag);
+    table->slots[target].hash = hash;
+    table->slots[target].key = key;
+    table->slots[target].value = NULL;
+    table->size++;
+    *stored = NULL;
+    return &table->slots[target].value;
+}
+
+static void **claimSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, int limit, void **spare, void **stored) {
+    // findOrAddSwissEntry for buildHASHMAPparallel, on a table without
+    // tombstones. table->size is left to the caller. Returns NULL instead of
+    // loading a group that reaches slot limit, so the mirrored bytes past
+    // the end of the array are only touched serially.
+    assert(map != NULL);
+    assert(table != NULL);
+    (void)spare;
+    unsigned char tag = TAG(hash);
+    for (int pos = indexFor(hash, table->capacity); pos + GROUP_WIDTH <= limit; pos += GROUP_WIDTH) {
+        const unsigned char *group = table->ctrl + pos;
+        for (unsigned int m = matchControl(group, tag); m != 0; m &= m - 1) {
+            SLOT *slot = &table->slots[pos + lowestBit(m)];
+            if (slot->hash == hash && SAME_KEY(map, slot->key, key)) {
+                *stored = slot->key;
+                return &slot->value;
+            }
+        }
+        unsigned int empty = matchControl(group, CTRL_EMPTY);
+        if (empty != 0) {
+            int i = pos + lowestBit(empty);
+            setControl(table, i, tag);
+            table->slots[i].hash = hash;
+            table->slots[i].key = key;
+            table->slots[i].value = NULL;
+            *stored = NULL;
+            return &table->slots[i].value;
+        }
+    }
+    return NULL;
+}
+
+static void addSwissEntry(HASHMAP *map, TABLE *table, void *key, void *value, unsigned int hash) {
+    (void)map;
+    assert(table != NULL);
+    int mask = table->capacity - 1;
+    int pos = indexFor(hash, table->capacity);
+    // take the first empty or deleted slot in the probe sequence
+    unsigned int vacant;
+    while ((vacant = matchFree(table->ctrl + pos)) == 0) pos = (pos + GROUP_WIDTH) & mask;
+    int i = (pos + lowestBit(vacant)) & mask;
+    if (table->ctrl[i] == CTRL_DELETED) table->tombstones--;
+    setControl(table, i, TAG(hash));
+    table->slots[i].hash = hash;
+    table->slots[i].key = key;
+    table->slots[i].value = value;
+    table->size++;
+}
+
+static void *removeSwissEntry(HASHMAP *map, TABLE *table, void *key, unsigned int hash, void **value) {
+    assert(map != NULL);
+    assert(table != NULL);
+    void **found = findSwissEntry(map, table, key, hash);
+    if (found == NULL) return NULL;
+    SLOT *slot = (SLOT *)((char *)found - offsetof(SLOT, value));
+    void *result = slot->key;
+    *value = slot->value;
+    // a tombstone keeps probes running past this slot
+    setControl(table, slot - table->slots, CTRL_DELETED);
+    table->size--;
+    table->tombstones++;
+    return result;
+}
+
+static void migrateSwissBucket(HASHMAP *map, TABLE *from, int index, TABLE *to) {
+    assert(map != NULL);
+    if (from->ctrl[index] & 0x80) return;
+    SLOT *slot = &from->slots[index];
+    addSwissEntry(map, to, slot->key, slot->value, slot->hash);
+    setControl(from, index, CTRL_DELETED);
+    from->size--;
+    from->tombstones++;
+}
+
+static void displaySwissBucket(HASHMAP *map, TABLE *table, int index, FILE *fp) {
+    assert(map != NULL);
+    SLOT *slot = &table->slots[index];
+    fprintf(fp, "{");
+    if (table->ctrl[index] == CTRL_DELETED) {
+        if (map->debugLevel > 0) fprintf(fp, "X");
+    }
+    else if (table->ctrl[index] != CTRL_EMPTY) displayEntry(map, slot->key, slot->value, fp);
+    fprintf(fp, "}");
+}
+
+static void walkSwissEntries(HASHMAP *map, TABLE *table, int from, int to, void (*visit)(void *, void **, unsigned int, int), void *ctx) {
+    (void)map;
+    for (int i = from; i < to; ++i) {
+        if ((table->ctrl[i] & 0x80) == 0) {
+            visit(ctx, &table->slots[i].key, table->slots[i].hash, i);
+        }
+    }
+}
+
+static void prefetchSwissEntry(HASHMAP *map, TABLE *table, unsigned int hash, int stage) {
+    // stage 0 fetches the control group, stage 1 the home slot and stage 2
+    // the key of the first tag match
+    (void)map;
+    int pos = indexFor(hash, table->capacity);
+    if (stage == 0) PREFETCH(table->ctrl + pos);
+    else if (stage == 1) PREFETCH(&table->slots[pos]);
+    else {
+        unsigned int m = matchControl(table->ctrl + pos, TAG(hash));
+        if (m != 0) PREFETCH(table->slots[(pos + lowestBit(m)) & (table->capacity - 1)].key);
+    }
+}
+
+static bool stepSwissEntry(HASHMAP *map, HASHMAPITER *iter) {
+    TABLE *table = map->table;
+    iter->removed = false;
+    for (int i = iter->index + 1; i < table->capacity; ++i) {
+        if ((table->ctrl[i] & 0x80) == 0) {
+            iter->index = i;
+            iter->pair = &table->slots[i].key;
+            return true;
+        }
+    }
+    iter->index = table->capacity;
+    iter->pair = NULL;
+    return false;
+}
+
+static void *removeSwissCurrent(HASHMAP *map, HASHMAPITER *iter, void **value) {
+    TABLE *table = map->table;
+    SLOT *slot = &table->slots[iter->index];
+    *value = slot->value;
+    setControl(table, iter->index, CTRL_DELETED);
+    table->size--;
+    table->tombstones++;
+    return slot->key;
 }
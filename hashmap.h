@@ -7,26 +7,169 @@
 #ifndef __HASHMAP_INCLUDED__
 #define __HASHMAP_INCLUDED__
 
+#include "slab.h"
+#include "threadpool.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 typedef struct HASHMAP HASHMAP;
 
+// A read-only snapshot written by saveHASHMAP, queried in place
+typedef struct HASHMAPVIEW HASHMAPVIEW;
+
+// A ring buffer of recent trace events, see newHASHMAPTRACER
+typedef struct HASHMAPTRACER HASHMAPTRACER;
+
+/*
+ *  Type: HASHMAPITER
+ *  Description: A position within a HASHMAP used to walk its entries in
+ *  memory order. Iterators live on the caller's stack; the fields are
+ *  private to hashmap.c. Only removeHASHMAPiter may modify the map while an
+ *  iterator is in use.
+ */
+typedef struct HASHMAPITER {
+    HASHMAP *map;
+    int index;          // bucket or slot of the current entry
+    void **pair;        // the current entry's key, followed by its value
+    void *link;         // chained: the pointer leading to the current node
+    bool removed;       // the current entry was removed through the iterator
+} HASHMAPITER;
+
+// Storage strategies selectable at construction time
+typedef enum HASHMAPBACKEND {
+    HASHMAP_CHAINED,            // one singly-linked list per bucket
+    HASHMAP_LINEAR_PROBING,     // flat slot array with linear probing
+    HASHMAP_SWISS               // control bytes matched 16 slots at a time
+} HASHMAPBACKEND;
+
+// Operations reported to a trace callback set by setHASHMAPtrace
+typedef enum HASHMAPEVENT {
+    HASHMAP_TRACE_PROBE,        // a lookup by getHASHMAPvalue, getHASHMAPbatch or containsKey
+    HASHMAP_TRACE_INSERT,       // an entry was added
+    HASHMAP_TRACE_REMOVE,       // an entry was removed
+    HASHMAP_TRACE_RESIZE        // a rehash into a new table started
+} HASHMAPEVENT;
+
+/*
+ *  Type: HASHMAPTRACE
+ *  Description: One traced operation. The key is recorded by address only
+ *  and may have been freed by the time a stored event is read.
+ */
+typedef struct HASHMAPTRACE {
+    HASHMAPEVENT event;
+    void *key;          // NULL for HASHMAP_TRACE_RESIZE
+    unsigned int hash;
+    int index;          // home bucket or slot of key in the current table
+    int capacity;       // of the current table; the new one for a resize
+    bool found;         // HASHMAP_TRACE_PROBE: the key was present
+} HASHMAPTRACE;
+
+// rows of the probe length histogram; the last row counts longer probes too
+#define HASHMAP_PROBE_ROWS 16
+
+/*
+ *  Type: HASHMAPSTATS
+ *  Description: Filled in by statsHASHMAP. The counters run from the map's
+ *  creation; buildHASHMAPparallel adds its inserts and prehash calls in
+ *  bulk and leaves out the comparator calls its workers make. Building
+ *  hashmap.c with -DHASHMAP_NO_STATS removes the counters, which then read
+ *  as zero. The remaining fields describe the tables as they stand when
+ *  statsHASHMAP is called.
+ */
+typedef struct HASHMAPSTATS {
+    long   gets;            // lookups by getHASHMAPvalue, getHASHMAPbatch and containsKey
+    long   hits;
+    long   misses;
+    long   inserts;         // entries added
+    long   removes;         // entries removed
+    long   compares;        // comparator calls
+    long   prehashes;       // prehash calls
+    long   resizes;         // rehashes started, tombstone purges included
+    long   rehashSteps;     // operations that moved buckets of a rehash along
+    double resizeSeconds;   // time spent allocating tables and finishing
+                            // rehashes in one go
+    long   probes[HASHMAP_PROBE_ROWS];  // entries found by examining i + 1
+                                        // chain nodes, slots or groups
+    int    longestProbe;
+    size_t bytes;           // memory held by the map, its tables and its nodes
+} HASHMAPSTATS;
+
+// A NULL comparator compares keys by address, for interned keys; a NULL
+// prehash hashes the address as well
 extern HASHMAP *newHASHMAP(int (*prehash)(void *), int (*comparator)(void *, void *));
+extern HASHMAP *newHASHMAPbackend(int (*prehash)(void *),
+                    int (*comparator)(void *, void *), HASHMAPBACKEND backend);
+extern HASHMAP *newHASHMAPreserved(int (*prehash)(void *),
+                    int (*comparator)(void *, void *), HASHMAPBACKEND backend, int entries);
 extern void    setHASHMAPdisplayKey(HASHMAP *map, void (*display)(void *, FILE *));
 extern void    setHASHMAPdisplayValue(HASHMAP *map, void (*display)(void *, FILE *));
 extern void    setHASHMAPfreeKey(HASHMAP *map, void (*free)(void *));
 extern void    setHASHMAPfreeValue(HASHMAP *map, void (*free)(void *));
+extern void    setHASHMAPkeyCodec(HASHMAP *map, size_t (*encode)(void *, void *, size_t),
+                    void *(*decode)(const void *, size_t));
+extern void    setHASHMAPvalueCodec(HASHMAP *map, size_t (*encode)(void *, void *, size_t),
+                    void *(*decode)(const void *, size_t));
+extern void    setHASHMAPtrace(HASHMAP *map, void (*trace)(const HASHMAPTRACE *, void *), void *ctx);
 extern double  setHASHMAPLoadFactor(HASHMAP *map, double loadFactor);
+extern void    setHASHMAPnodePool(HASHMAP *map, bool enabled);
+extern bool    statsHASHMAPpool(HASHMAP *map, SLABSTATS *stats);
+extern void    statsHASHMAP(HASHMAP *map, HASHMAPSTATS *stats);
+extern void    reserveHASHMAP(HASHMAP *map, int entries);
+extern void    shrinkToFitHASHMAP(HASHMAP *map);
+// When the key is already present the map keeps the key it holds.
+// insertHASHMAP and the batch, build, load and restore calls own what they
+// are given, so they free the duplicate key and the displaced value.
+// insertOrAssignHASHMAP, insertIfAbsentHASHMAP and getOrInsertHASHMAP free
+// nothing: the duplicate key stays with the caller, as does the displaced
+// value insertOrAssignHASHMAP returns.
 extern void    insertHASHMAP(HASHMAP *map, void *key, void *value);
+extern void   *insertOrAssignHASHMAP(HASHMAP *map, void *key, void *value);
+extern bool    insertIfAbsentHASHMAP(HASHMAP *map, void *key, void *value);
+extern void  **getOrInsertHASHMAP(HASHMAP *map, void *key, bool *inserted);
 extern void   *removeHASHMAP(HASHMAP *map, void *key);
 extern void   *getHASHMAPvalue(HASHMAP *map, void *key);
+extern void    insertHASHMAPbatch(HASHMAP *map, void **keys, void **values, int count);
+extern void    getHASHMAPbatch(HASHMAP *map, void **keys, void **values, int count);
+extern void    buildHASHMAPparallel(HASHMAP *map, THREADPOOL *pool,
+                    void **keys, void **values, int count);
 extern void    clearHASHMAP(HASHMAP *map);
+extern void    clearHASHMAPparallel(HASHMAP *map, THREADPOOL *pool);
 extern bool    containsKey(HASHMAP *map, void *key);
 extern bool    isHASHMAPempty(HASHMAP *map);
 extern int     sizeHASHMAP(HASHMAP *map);
+extern bool    firstHASHMAP(HASHMAP *map, HASHMAPITER *iter);
+extern bool    nextHASHMAP(HASHMAPITER *iter);
+extern void   *keyHASHMAPiter(HASHMAPITER *iter);
+extern void   *valueHASHMAPiter(HASHMAPITER *iter);
+extern void   *removeHASHMAPiter(HASHMAPITER *iter);
+extern void    forEachHASHMAP(HASHMAP *map, void (*callback)(void *, void *, void *), void *ctx);
+extern void    forEachHASHMAPparallel(HASHMAP *map, THREADPOOL *pool,
+                    void (*callback)(void *, void *, void *), void *ctx);
 extern void    displayHASHMAP(HASHMAP *map, FILE *fp);
+extern void    displayHASHMAPdistribution(HASHMAP *map, FILE *fp);
+extern bool    saveHASHMAP(HASHMAP *map, const char *path);
+extern bool    loadHASHMAP(HASHMAP *map, const char *path);
+extern bool    dumpHASHMAP(HASHMAP *map, int fd);
+extern bool    restoreHASHMAP(HASHMAP *map, int fd, THREADPOOL *pool);
 extern int     debugHASHMAP(HASHMAP *map, int level);
 extern void    freeHASHMAP(HASHMAP *map);
+extern void    freeHASHMAPparallel(HASHMAP *map, THREADPOOL *pool);
+
+extern HASHMAPVIEW *loadHASHMAPview(const char *path, int (*prehash)(void *),
+                        size_t (*encodeKey)(void *, void *, size_t));
+extern const void  *getHASHMAPVIEWvalue(HASHMAPVIEW *view, void *key, size_t *length);
+extern bool         containsHASHMAPVIEWkey(HASHMAPVIEW *view, void *key);
+extern int          sizeHASHMAPVIEW(HASHMAPVIEW *view);
+extern void         freeHASHMAPVIEW(HASHMAPVIEW *view);
+
+// recordHASHMAPTRACER is the trace callback, with the tracer as its ctx
+extern HASHMAPTRACER *newHASHMAPTRACER(int capacity);
+extern void           recordHASHMAPTRACER(const HASHMAPTRACE *event, void *tracer);
+extern int            sizeHASHMAPTRACER(HASHMAPTRACER *tracer);
+extern long           countHASHMAPTRACER(HASHMAPTRACER *tracer);
+extern bool           getHASHMAPTRACERevent(HASHMAPTRACER *tracer, int index, HASHMAPTRACE *event);
+extern void           displayHASHMAPTRACER(HASHMAPTRACER *tracer, FILE *fp);
+extern void           freeHASHMAPTRACER(HASHMAPTRACER *tracer);
 
 #endif // !__HASHMAP_INCLUDED__
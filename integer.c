@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <assert.h>
+#include <string.h>
 #include "integer.h"
 
 struct INTEGER {
@@ -29,6 +30,41 @@ void displayINTEGER(void *v,FILE *fp) {
     fprintf(fp,"%d",getINTEGER((INTEGER *) v));
 }
 
+/*
+ *  Function: prehashINTEGER
+ *  Description: Scrambles the value with a multiply-xorshift mix so that
+ *  sequential or strided integers spread across all bits of the hash.
+ */
+int prehashINTEGER(void *v) {
+    unsigned int h = (unsigned int)getINTEGER((INTEGER *) v);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (int)h;
+}
+
+/*
+ *  Function: encodeINTEGER
+ *  Usage: setHASHMAPkeyCodec(map, encodeINTEGER, decodeINTEGER);
+ *  Description: Snapshot codec for INTEGERs: the value's bytes in the
+ *  machine's own order.
+ */
+size_t encodeINTEGER(void *v,void *buffer,size_t size) {
+    int x = getINTEGER((INTEGER *) v);
+    if (size >= sizeof(x)) memcpy(buffer,&x,sizeof(x));
+    return sizeof(x);
+}
+
+void *decodeINTEGER(const void *bytes,size_t length) {
+    int x;
+    assert(length == sizeof(x));
+    (void)length;
+    memcpy(&x,bytes,sizeof(x));
+    return newINTEGER(x);
+}
+
 int compareINTEGER(void *v,void *w) {
     return getINTEGER(v) - getINTEGER(w);
 }
@@ -1,6 +1,7 @@
 #ifndef __INTEGER_INCLUDED__
 #define __INTEGER_INCLUDED__
 
+#include <stddef.h>
 #include <stdio.h>
 
 typedef struct INTEGER INTEGER;
@@ -8,9 +9,12 @@ typedef struct INTEGER INTEGER;
 extern INTEGER *newINTEGER(int);
 extern int getINTEGER(INTEGER *);
 extern int setINTEGER(INTEGER *,int);
+extern int prehashINTEGER(void *);
 extern int compareINTEGER(void *,void *);
 extern int rcompareINTEGER(void *,void *);
 extern void displayINTEGER(void *,FILE *);
+extern size_t encodeINTEGER(void *,void *,size_t);
+extern void *decodeINTEGER(const void *,size_t);
 extern void freeINTEGER(void *);
 
 #endif // !__INTEGER_INCLUDED__
@@ -0,0 +1,92 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   intern.c
+ *  Description: This is the implementation file for the string interning
+ *  table. It is a HASHMAP from each canonical STRING to itself. Lookups go
+ *  through a reusable probe STRING, so a hit allocates nothing; a miss
+ *  copies the bytes once and keeps them until the table is freed.
+ */
+
+#include "intern.h"
+#include "hashmap.h"
+#include "string.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/********** Interning Table Struct **********/
+
+struct INTERN {
+    HASHMAP *strings;   // canonical STRING -> itself
+    STRING *probe;      // wraps the caller's bytes during a lookup
+};
+
+
+/********** Private Method Prototypes **********/
+static void freeInterned(void *str);
+
+
+/********** Public Method Definitions **********/
+
+INTERN *newINTERN(void) {
+    INTERN *table = malloc(sizeof(INTERN));
+    assert(table != NULL);
+    table->strings = newHASHMAPbackend(prehashSTRING, compareSTRINGequality, HASHMAP_SWISS);
+    setHASHMAPfreeKey(table->strings, freeInterned);
+    table->probe = newSTRINGlength("", 0);
+    return table;
+}
+
+STRING *internSTRING(INTERN *table, char *x) {
+    assert(x != NULL);
+    return internSTRINGlength(table, x, strlen(x));
+}
+
+STRING *internSTRINGlength(INTERN *table, char *x, int length) {
+    // Returns the canonical STRING for the length bytes at x, creating it
+    // from a NUL-terminated copy of them on first sight.
+    assert(table != NULL);
+    STRING *canonical = lookupINTERN(table, x, length);
+    if (canonical != NULL) return canonical;
+    char *copy = malloc(length + 1);
+    assert(copy != NULL);
+    memcpy(copy, x, length);
+    copy[length] = '\0';
+    canonical = newSTRINGlength(copy, length);
+    // hash now so the cached hash is never written once the STRING is shared
+    prehashSTRING(canonical);
+    insertHASHMAP(table->strings, canonical, canonical);
+    return canonical;
+}
+
+STRING *lookupINTERN(INTERN *table, char *x, int length) {
+    // Returns the canonical STRING for the length bytes at x, or NULL if
+    // they have not been interned.
+    assert(table != NULL);
+    assert(x != NULL && length >= 0);
+    setSTRINGlength(table->probe, x, length);
+    return getHASHMAPvalue(table->strings, table->probe);
+}
+
+int sizeINTERN(INTERN *table) {
+    assert(table != NULL);
+    return sizeHASHMAP(table->strings);
+}
+
+void freeINTERN(INTERN *table) {
+    // Frees every canonical STRING, so none may be used afterwards.
+    assert(table != NULL);
+    freeHASHMAP(table->strings);
+    freeSTRING(table->probe);
+    free(table);
+}
+
+
+/********** Private Method Definitions **********/
+
+static void freeInterned(void *str) {
+    free(getSTRING(str));
+    freeSTRING(str);
+}
@@ -0,0 +1,24 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   intern.h
+ *  Description: This is the public interface for the string interning
+ *  table. Each distinct byte sequence maps to one canonical STRING, so
+ *  interned keys can be stored once and compared by address in a HASHMAP
+ *  built with a NULL comparator.
+ */
+
+#ifndef __INTERN_INCLUDED__
+#define __INTERN_INCLUDED__
+
+#include "string.h"
+
+typedef struct INTERN INTERN;
+
+extern INTERN *newINTERN(void);
+extern STRING *internSTRING(INTERN *table, char *x);
+extern STRING *internSTRINGlength(INTERN *table, char *x, int length);
+extern STRING *lookupINTERN(INTERN *table, char *x, int length);
+extern int     sizeINTERN(INTERN *table);
+extern void    freeINTERN(INTERN *table);
+
+#endif // !__INTERN_INCLUDED__
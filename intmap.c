@@ -0,0 +1,238 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   intmap.c
+ *  Description: This is the implementation file for the integer-key map.
+ *
+ *  Entries live in one flat array of {key, value} slots probed linearly. A
+ *  zero key marks an empty slot, so the entry for key 0 itself is kept
+ *  beside the table. Removal shifts the rest of the probe run back instead
+ *  of leaving tombstones, so lookups never walk over deleted slots.
+ */
+
+#include "intmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/********** Global Constants **********/
+#define INITIAL_CAPACITY 16
+#define LOAD_FACTOR 0.75
+#define GROWTH_FACTOR 2
+
+
+/********** Slot Struct **********/
+
+typedef struct intslot {
+    int64_t key;        // 0 marks an empty slot
+    void *value;
+} INTSLOT;
+
+
+/********** Integer Map Struct **********/
+
+struct INTMAP {
+    int size;
+    int capacity;
+    INTSLOT *slots;
+
+    // the entry for key 0, which cannot live in the table
+    bool hasZero;
+    void *zeroValue;
+
+    void (*freeValue)(void *);
+};
+
+
+/********** Private Method Prototypes **********/
+static unsigned int hash(int64_t key);
+static int find(INTMAP *map, int64_t key);
+static void resize(INTMAP *map, int capacity);
+
+
+/********** Public Method Definitions **********/
+
+INTMAP *newINTMAP(void) {
+    INTMAP *map = malloc(sizeof(INTMAP));
+    assert(map != NULL);
+    map->size = 0;
+    map->capacity = INITIAL_CAPACITY;
+    map->slots = calloc(INITIAL_CAPACITY, sizeof(INTSLOT));
+    assert(map->slots != NULL);
+    map->hasZero = false;
+    map->zeroValue = NULL;
+    map->freeValue = NULL;
+    return map;
+}
+
+void setINTMAPfreeValue(INTMAP *map, void (*free)(void *)) {
+    assert(map != NULL);
+    map->freeValue = free;
+}
+
+void reserveINTMAP(INTMAP *map, int entries) {
+    assert(map != NULL);
+    assert(entries >= 0);
+    int capacity = map->capacity;
+    while (capacity * LOAD_FACTOR < entries) capacity *= GROWTH_FACTOR;
+    if (capacity > map->capacity) resize(map, capacity);
+}
+
+void insertINTMAP(INTMAP *map, int64_t key, void *value) {
+    // Inserts key or replaces its value; the displaced value is freed.
+    assert(map != NULL);
+    bool inserted;
+    void **slot = getOrInsertINTMAP(map, key, &inserted);
+    if (!inserted && *slot != NULL && *slot != value && map->freeValue != NULL) {
+        map->freeValue(*slot);
+    }
+    *slot = value;
+}
+
+void **getOrInsertINTMAP(INTMAP *map, int64_t key, bool *inserted) {
+    // Returns the address of key's value, adding key with a NULL value if it
+    // is absent. The address is valid until the map is next modified.
+    assert(map != NULL);
+    bool added = false;
+    void **value;
+    if (key == 0) {
+        added = !map->hasZero;
+        if (added) {
+            map->hasZero = true;
+            map->zeroValue = NULL;
+            map->size++;
+        }
+        value = &map->zeroValue;
+    }
+    else {
+        if (map->size + 1 > map->capacity * LOAD_FACTOR) {
+            resize(map, map->capacity * GROWTH_FACTOR);
+        }
+        int mask = map->capacity - 1;
+        int i = hash(key) & mask;
+        while (map->slots[i].key != 0 && map->slots[i].key != key) i = (i + 1) & mask;
+        if (map->slots[i].key == 0) {
+            map->slots[i].key = key;
+            map->slots[i].value = NULL;
+            map->size++;
+            added = true;
+        }
+        value = &map->slots[i].value;
+    }
+    if (inserted != NULL) *inserted = added;
+    return value;
+}
+
+void *getINTMAPvalue(INTMAP *map, int64_t key) {
+    assert(map != NULL);
+    if (key == 0) return map->hasZero ? map->zeroValue : NULL;
+    int i = find(map, key);
+    return i < 0 ? NULL : map->slots[i].value;
+}
+
+bool containsINTMAPkey(INTMAP *map, int64_t key) {
+    assert(map != NULL);
+    if (key == 0) return map->hasZero;
+    return find(map, key) >= 0;
+}
+
+bool removeINTMAP(INTMAP *map, int64_t key) {
+    // Removes key and frees its value; returns false if key was absent.
+    assert(map != NULL);
+    void *value;
+    if (key == 0) {
+        if (!map->hasZero) return false;
+        value = map->zeroValue;
+        map->hasZero = false;
+        map->zeroValue = NULL;
+    }
+    else {
+        int i = find(map, key);
+        if (i < 0) return false;
+        value = map->slots[i].value;
+        // pull later entries of the run back over the hole, skipping any
+        // whose home lies cyclically between the hole and their slot
+        int mask = map->capacity - 1;
+        for (int j = (i + 1) & mask; map->slots[j].key != 0; j = (j + 1) & mask) {
+            int home = hash(map->slots[j].key) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                map->slots[i] = map->slots[j];
+                i = j;
+            }
+        }
+        map->slots[i].key = 0;
+        map->slots[i].value = NULL;
+    }
+    map->size--;
+    if (value != NULL && map->freeValue != NULL) map->freeValue(value);
+    return true;
+}
+
+int sizeINTMAP(INTMAP *map) {
+    assert(map != NULL);
+    return map->size;
+}
+
+void clearINTMAP(INTMAP *map) {
+    // Empties the map but keeps its capacity.
+    assert(map != NULL);
+    for (int i = 0; i < map->capacity; ++i) {
+        if (map->slots[i].key == 0) continue;
+        if (map->slots[i].value != NULL && map->freeValue != NULL) {
+            map->freeValue(map->slots[i].value);
+        }
+        map->slots[i].key = 0;
+        map->slots[i].value = NULL;
+    }
+    if (map->hasZero && map->zeroValue != NULL && map->freeValue != NULL) {
+        map->freeValue(map->zeroValue);
+    }
+    map->hasZero = false;
+    map->zeroValue = NULL;
+    map->size = 0;
+}
+
+void freeINTMAP(INTMAP *map) {
+    assert(map != NULL);
+    clearINTMAP(map);
+    free(map->slots);
+    free(map);
+}
+
+
+/********** Private Method Definitions **********/
+
+static unsigned int hash(int64_t key) {
+    // splitmix64 finalizer, folded to the bits indexing uses
+    uint64_t h = (uint64_t)key;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return (unsigned int)(h ^ (h >> 31));
+}
+
+static int find(INTMAP *map, int64_t key) {
+    // Returns the slot holding key, which must not be 0, or -1.
+    int mask = map->capacity - 1;
+    for (int i = hash(key) & mask; map->slots[i].key != 0; i = (i + 1) & mask) {
+        if (map->slots[i].key == key) return i;
+    }
+    return -1;
+}
+
+static void resize(INTMAP *map, int capacity) {
+    INTSLOT *old = map->slots;
+    int oldCapacity = map->capacity;
+    map->slots = calloc(capacity, sizeof(INTSLOT));
+    assert(map->slots != NULL);
+    map->capacity = capacity;
+    int mask = capacity - 1;
+    for (int i = 0; i < oldCapacity; ++i) {
+        if (old[i].key == 0) continue;
+        int j = hash(old[i].key) & mask;
+        while (map->slots[j].key != 0) j = (j + 1) & mask;
+        map->slots[j] = old[i];
+    }
+    free(old);
+}
@@ -0,0 +1,29 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   intmap.h
+ *  Description: This is the public interface for the integer-key map. Keys
+ *  are 64-bit integers stored inline in the table, so nothing is boxed and
+ *  hashing and comparison need no callbacks.
+ */
+
+#ifndef __INTMAP_INCLUDED__
+#define __INTMAP_INCLUDED__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct INTMAP INTMAP;
+
+extern INTMAP *newINTMAP(void);
+extern void    setINTMAPfreeValue(INTMAP *map, void (*free)(void *));
+extern void    reserveINTMAP(INTMAP *map, int entries);
+extern void    insertINTMAP(INTMAP *map, int64_t key, void *value);
+extern void  **getOrInsertINTMAP(INTMAP *map, int64_t key, bool *inserted);
+extern void   *getINTMAPvalue(INTMAP *map, int64_t key);
+extern bool    containsINTMAPkey(INTMAP *map, int64_t key);
+extern bool    removeINTMAP(INTMAP *map, int64_t key);
+extern int     sizeINTMAP(INTMAP *map);
+extern void    clearINTMAP(INTMAP *map);
+extern void    freeINTMAP(INTMAP *map);
+
+#endif // !__INTMAP_INCLUDED__
@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 #include "real.h"
 
 struct REAL {
@@ -36,6 +38,27 @@ void displayREAL(void *v, FILE *fp) {
     fprintf(fp, "%f", getREAL((REAL *)v));
 }
 
+/*
+ *  Function: prehashREAL
+ *  Description: Hashes the bit pattern of the value with a 64-bit mix folded
+ *  down to 32 bits. Values that compare equal hash equally: -0.0 is treated
+ *  as 0.0 and every NaN hashes alike.
+ */
+int prehashREAL(void *v) {
+    assert(v != NULL);
+    double x = getREAL(v);
+    if (x == 0.0) x = 0.0;
+    uint64_t h;
+    if (x != x) h = 0x7ff8000000000000ull;
+    else memcpy(&h, &x, sizeof(h));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return (int)(uint32_t)(h ^ (h >> 32));
+}
+
 int compareREAL(void *v, void *w) {
     assert(v != NULL && w != NULL);
     if (getREAL(v) < getREAL(w)) return -1;
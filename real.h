@@ -14,6 +14,7 @@ typedef struct REAL REAL;
 extern REAL *newREAL(double);
 extern double getREAL(REAL *);
 extern double setREAL(REAL*, double v);
+extern int prehashREAL(void *);
 extern int compareREAL(void *, void *);
 extern int rcompareREAL(void *, void *);
 extern void displayREAL(void *, FILE *);
@@ -0,0 +1,127 @@
+/*
+ *  File:   slab.c
+ *  Author: Brett Heithold
+ *  Description: This is the implementation file for the slab allocator.
+ *  Blocks are bump-allocated from the newest slab; released blocks go onto
+ *  a free list and are reused before the slab is touched again. Slabs are
+ *  only returned to malloc in bulk by clearSLAB and freeSLAB.
+ */
+
+#include "slab.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#define SLAB_BYTES 65536        // target size of one slab
+#define SLAB_ALIGNMENT 16       // alignment of every block
+#define SLAB_HEADER SLAB_ALIGNMENT
+
+
+/********** Slab Struct **********/
+
+struct SLAB {
+    int blockSize;
+    int blocksPerSlab;
+    int slabs;
+    long blocksInUse;
+    void *slabList;     // newest slab; each slab's header links to the previous
+    void *freeList;     // released blocks; each block's first word links onward
+    char *next;         // next untouched block in the newest slab
+    char *limit;        // end of the newest slab
+};
+
+
+/********** Private Method Prototypes **********/
+static void addSlab(SLAB *slab);
+
+
+/********** Public Method Definitions **********/
+
+SLAB *newSLAB(int blockSize) {
+    assert(blockSize > 0);
+    SLAB *slab = malloc(sizeof(SLAB));
+    assert(slab != NULL);
+    // every block must hold a free-list link and keep the next one aligned
+    if (blockSize < (int)sizeof(void *)) blockSize = sizeof(void *);
+    slab->blockSize = (blockSize + SLAB_ALIGNMENT - 1) & ~(SLAB_ALIGNMENT - 1);
+    slab->blocksPerSlab = (SLAB_BYTES - SLAB_HEADER) / slab->blockSize;
+    if (slab->blocksPerSlab < 1) slab->blocksPerSlab = 1;
+    slab->slabs = 0;
+    slab->blocksInUse = 0;
+    slab->slabList = NULL;
+    slab->freeList = NULL;
+    slab->next = NULL;
+    slab->limit = NULL;
+    return slab;
+}
+
+void *allocSLAB(SLAB *slab) {
+    assert(slab != NULL);
+    void *block;
+    if (slab->freeList != NULL) {
+        // reuse a released block first
+        block = slab->freeList;
+        slab->freeList = *(void **)block;
+    }
+    else {
+        if (slab->next == slab->limit) addSlab(slab);
+        block = slab->next;
+        slab->next += slab->blockSize;
+    }
+    slab->blocksInUse++;
+    return block;
+}
+
+void releaseSLAB(SLAB *slab, void *block) {
+    assert(slab != NULL);
+    assert(block != NULL);
+    *(void **)block = slab->freeList;
+    slab->freeList = block;
+    slab->blocksInUse--;
+}
+
+void clearSLAB(SLAB *slab) {
+    assert(slab != NULL);
+    // return every slab at once; outstanding blocks become invalid
+    while (slab->slabList != NULL) {
+        void *previous = *(void **)slab->slabList;
+        free(slab->slabList);
+        slab->slabList = previous;
+    }
+    slab->slabs = 0;
+    slab->blocksInUse = 0;
+    slab->freeList = NULL;
+    slab->next = NULL;
+    slab->limit = NULL;
+}
+
+void statsSLAB(SLAB *slab, SLABSTATS *stats) {
+    assert(slab != NULL);
+    assert(stats != NULL);
+    stats->slabs = slab->slabs;
+    stats->blockSize = slab->blockSize;
+    stats->blocks = (long)slab->slabs * slab->blocksPerSlab;
+    stats->blocksInUse = slab->blocksInUse;
+    stats->bytes = (size_t)slab->slabs
+        * (SLAB_HEADER + (size_t)slab->blocksPerSlab * slab->blockSize);
+    stats->bytesInUse = (size_t)slab->blocksInUse * slab->blockSize;
+}
+
+void freeSLAB(SLAB *slab) {
+    assert(slab != NULL);
+    clearSLAB(slab);
+    free(slab);
+}
+
+
+/********** Private Method Definitions **********/
+
+static void addSlab(SLAB *slab) {
+    assert(slab != NULL);
+    char *memory = malloc(SLAB_HEADER + (size_t)slab->blocksPerSlab * slab->blockSize);
+    assert(memory != NULL);
+    *(void **)memory = slab->slabList;
+    slab->slabList = memory;
+    slab->next = memory + SLAB_HEADER;
+    slab->limit = slab->next + (size_t)slab->blocksPerSlab * slab->blockSize;
+    slab->slabs++;
+}
@@ -0,0 +1,31 @@
+/*
+ *  File:   slab.h
+ *  Author: Brett Heithold
+ *  Description: This is the public interface for the slab allocator, which
+ *  hands out fixed-size blocks carved from large slabs.
+ */
+
+#ifndef __SLAB_INCLUDED__
+#define __SLAB_INCLUDED__
+
+#include <stddef.h>
+
+typedef struct SLAB SLAB;
+
+typedef struct SLABSTATS {
+    int    slabs;           // slabs currently allocated
+    int    blockSize;       // bytes per block, after alignment
+    long   blocks;          // blocks the slabs can hold
+    long   blocksInUse;     // blocks handed out and not yet released
+    size_t bytes;           // bytes obtained from malloc
+    size_t bytesInUse;      // bytes of the blocks in use
+} SLABSTATS;
+
+extern SLAB *newSLAB(int blockSize);
+extern void *allocSLAB(SLAB *slab);
+extern void  releaseSLAB(SLAB *slab, void *block);
+extern void  clearSLAB(SLAB *slab);
+extern void  statsSLAB(SLAB *slab, SLABSTATS *stats);
+extern void  freeSLAB(SLAB *slab);
+
+#endif // !__SLAB_INCLUDED__
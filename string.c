@@ -8,16 +8,37 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include "string.h"
 
 struct STRING {
-    char *value;
+    char *value;        // borrowed, not necessarily NUL-terminated
+    int length;
+    unsigned int hash;  // valid once hashed is set
+    bool hashed;        // read and set atomically, see prehashSTRING
 };
 
+static bool cachedHash(STRING *p, unsigned int *hash);
+
 STRING *newSTRING(char *x) {
+    assert(x != 0);
+    return newSTRINGlength(x, strlen(x));
+}
+
+/*
+ *  Function: newSTRINGlength
+ *  Usage: STRING *s = newSTRINGlength(frame + offset, 12);
+ *  Description: Wraps length bytes at x without copying them. The bytes
+ *  need not be NUL-terminated, so getSTRING callers must use lengthSTRING.
+ */
+STRING *newSTRINGlength(char *x, int length) {
+    assert(x != 0 && length >= 0);
     STRING *p = malloc(sizeof(STRING));
     assert(p != 0);
     p->value = x;
+    p->length = length;
+    p->hashed = false;
     return p;
 }
 
@@ -27,31 +48,158 @@ char *getSTRING(STRING *p) {
 }
 
 char *setSTRING(STRING *p, char *v) {
-    assert(p != 0);
+    assert(p != 0 && v != 0);
     char *old = p->value;
     p->value = v;
+    p->length = strlen(v);
+    p->hashed = false;
+    return old;
+}
+
+char *setSTRINGlength(STRING *p, char *v, int length) {
+    // like setSTRING, for bytes that need not be NUL-terminated
+    assert(p != 0 && v != 0 && length >= 0);
+    char *old = p->value;
+    p->value = v;
+    p->length = length;
+    p->hashed = false;
     return old;
 }
 
 int lengthSTRING(STRING *str) {
     assert(str != NULL);
-    return strlen(str->value);
+    return str->length;
+}
+
+/*
+ *  Function: prehashSTRING
+ *  Usage: HASHMAP *m = newHASHMAP(prehashSTRING, compareSTRINGequality);
+ *  Description: Hashes the characters of a STRING with 32-bit MurmurHash3,
+ *  reading four bytes per round. Unlike summing the characters, it separates
+ *  anagrams and short keys. The hash is computed on first use and cached
+ *  until setSTRING. Threads may hash the same STRING at once, as the
+ *  workers of buildHASHMAPparallel do when a key object repeats: each
+ *  computes the same value, and the cache is filled in with atomic stores.
+ */
+int prehashSTRING(void *str) {
+    assert(str != NULL);
+    STRING *p = str;
+    unsigned int cached;
+    if (cachedHash(p, &cached)) return (int)cached;
+    const unsigned char *bytes = (const unsigned char *)p->value;
+    int length = p->length;
+    uint32_t h = 0x9747b28cu;
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t k;
+        memcpy(&k, bytes + i, sizeof(k));
+        k *= 0xcc9e2d51u;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593u;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64u;
+    }
+    uint32_t k = 0;
+    switch (length & 3) {
+        case 3: k ^= (uint32_t)bytes[i + 2] << 16; // fall through
+        case 2: k ^= (uint32_t)bytes[i + 1] << 8;  // fall through
+        case 1: k ^= bytes[i];
+                k *= 0xcc9e2d51u;
+                k = (k << 15) | (k >> 17);
+                k *= 0x1b873593u;
+                h ^= k;
+    }
+    h ^= (uint32_t)length;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    // hash is published by the release store of hashed
+    __atomic_store_n(&p->hash, h, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->hashed, true, __ATOMIC_RELEASE);
+    return (int)h;
+}
+
+/*
+ *  Function: equalsSTRING
+ *  Description: Tests two STRINGs for equality, rejecting on a length or
+ *  cached hash mismatch before comparing any characters.
+ */
+bool equalsSTRING(void *str1, void *str2) {
+    assert(str1 != NULL && str2 != NULL);
+    STRING *a = str1, *b = str2;
+    if (a->length != b->length) return false;
+    unsigned int hashA, hashB;
+    if (cachedHash(a, &hashA) && cachedHash(b, &hashB) && hashA != hashB) return false;
+    return memcmp(a->value, b->value, a->length) == 0;
 }
 
 int compareSTRING(void *str1, void *str2) {
+    // byte-wise order, shorter first on a common prefix, as strcmp orders
     assert(str1 != NULL && str2 != NULL);
-    return strcmp(getSTRING(str1), getSTRING(str2));
+    STRING *a = str1, *b = str2;
+    int common = a->length < b->length ? a->length : b->length;
+    int result = memcmp(a->value, b->value, common);
+    if (result != 0) return result;
+    return (a->length > b->length) - (a->length < b->length);
+}
+
+/*
+ *  Function: compareSTRINGequality
+ *  Usage: HASHMAP *m = newHASHMAP(prehashSTRING, compareSTRINGequality);
+ *  Description: A comparator for maps and other users that only test for
+ *  equality: returns 0 when equalsSTRING holds and 1 otherwise, so it keeps
+ *  the length and cached hash rejects that compareSTRING, which must order
+ *  its operands, cannot take.
+ */
+int compareSTRINGequality(void *str1, void *str2) {
+    return !equalsSTRING(str1, str2);
 }
 
 int rcompareSTRING(void *str1, void *str2) {
-    assert(str1 != NULL && str2 != NULL);
-    return strcmp(getSTRING(str2), getSTRING(str1));
+    return compareSTRING(str2, str1);
 }
 
 void displaySTRING(void *v, FILE *fp) {
-    fprintf(fp, "%s", getSTRING((STRING *)v));
+    STRING *p = v;
+    fprintf(fp, "%.*s", p->length, p->value);
+}
+
+/*
+ *  Function: encodeSTRING
+ *  Usage: setHASHMAPkeyCodec(map, encodeSTRING, decodeSTRING);
+ *  Description: Snapshot codec for STRINGs: the characters alone, without a
+ *  terminator. decodeSTRING copies them into the same allocation as the
+ *  STRING, so freeSTRING releases both.
+ */
+size_t encodeSTRING(void *v, void *buffer, size_t size) {
+    STRING *p = v;
+    if (size >= (size_t)p->length) memcpy(buffer, p->value, p->length);
+    return p->length;
+}
+
+void *decodeSTRING(const void *bytes, size_t length) {
+    STRING *p = malloc(sizeof(STRING) + length + 1);
+    assert(p != 0);
+    char *value = (char *)(p + 1);
+    memcpy(value, bytes, length);
+    value[length] = '\0';
+    p->value = value;
+    p->length = length;
+    p->hashed = false;
+    return p;
 }
 
 void freeSTRING(void *v) {
     free((STRING *)v);
 }
+
+
+static bool cachedHash(STRING *p, unsigned int *hash) {
+    // reads the cached hash, which another thread may be filling in
+    if (!__atomic_load_n(&p->hashed, __ATOMIC_ACQUIRE)) return false;
+    *hash = __atomic_load_n(&p->hash, __ATOMIC_RELAXED);
+    return true;
+}
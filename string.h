@@ -7,17 +7,26 @@
 #ifndef __STRING_INCLUDED__
 #define __STRING_INCLUDED__
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 typedef struct STRING STRING;
 
 extern STRING *newSTRING(char *);
+extern STRING *newSTRINGlength(char *, int);
 extern char *getSTRING(STRING *);
 extern char *setSTRING(STRING *, char *);
+extern char *setSTRINGlength(STRING *, char *, int);
 extern int lengthSTRING(STRING *);
+extern int prehashSTRING(void *);
+extern bool equalsSTRING(void *, void *);
 extern int compareSTRING(void *, void *);
+extern int compareSTRINGequality(void *, void *);
 extern int rcompareSTRING(void *, void *);
 extern void displaySTRING(void *, FILE *);
+extern size_t encodeSTRING(void *, void *, size_t);
+extern void *decodeSTRING(const void *, size_t);
 extern void freeSTRING(void *);
 
 #endif // !__STRING_INCLUDED__
@@ -0,0 +1,251 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   strmap.c
+ *  Description: This is the implementation file for the string-key map.
+ *
+ *  Entries live in one flat array of slots probed linearly. A slot caches
+ *  the key's hash and length and holds the characters themselves when they
+ *  fit in STRMAP_INLINE bytes; longer keys are copied to the heap. Probes
+ *  compare hash and length before touching any characters. Removal shifts
+ *  the rest of the probe run back instead of leaving tombstones.
+ */
+
+#include "strmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/********** Global Constants **********/
+#define INITIAL_CAPACITY 16
+#define LOAD_FACTOR 0.75
+#define GROWTH_FACTOR 2
+
+
+/********** Slot Struct **********/
+
+typedef struct strslot {
+    unsigned int hash;
+    unsigned int fill;      // 0 for an empty slot, else key length + 1
+    union {
+        char bytes[STRMAP_INLINE + 1];  // keys of up to STRMAP_INLINE chars
+        char *heap;                     // longer keys
+    } key;
+    void *value;
+} STRSLOT;
+
+
+/********** String Map Struct **********/
+
+struct STRMAP {
+    int size;
+    int capacity;
+    STRSLOT *slots;
+    void (*freeValue)(void *);
+};
+
+
+/********** Private Method Prototypes **********/
+static unsigned int hash(const char *key, size_t length);
+static const char *keyOf(STRSLOT *slot);
+static int find(STRMAP *map, const char *key, size_t length, unsigned int h);
+static void resize(STRMAP *map, int capacity);
+
+
+/********** Public Method Definitions **********/
+
+STRMAP *newSTRMAP(void) {
+    STRMAP *map = malloc(sizeof(STRMAP));
+    assert(map != NULL);
+    map->size = 0;
+    map->capacity = INITIAL_CAPACITY;
+    map->slots = calloc(INITIAL_CAPACITY, sizeof(STRSLOT));
+    assert(map->slots != NULL);
+    map->freeValue = NULL;
+    return map;
+}
+
+void setSTRMAPfreeValue(STRMAP *map, void (*free)(void *)) {
+    assert(map != NULL);
+    map->freeValue = free;
+}
+
+void reserveSTRMAP(STRMAP *map, int entries) {
+    assert(map != NULL);
+    assert(entries >= 0);
+    int capacity = map->capacity;
+    while (capacity * LOAD_FACTOR < entries) capacity *= GROWTH_FACTOR;
+    if (capacity > map->capacity) resize(map, capacity);
+}
+
+void insertSTRMAP(STRMAP *map, const char *key, void *value) {
+    // Inserts a copy of key or replaces its value; the displaced value is
+    // freed.
+    assert(map != NULL);
+    bool inserted;
+    void **slot = getOrInsertSTRMAP(map, key, &inserted);
+    if (!inserted && *slot != NULL && *slot != value && map->freeValue != NULL) {
+        map->freeValue(*slot);
+    }
+    *slot = value;
+}
+
+void **getOrInsertSTRMAP(STRMAP *map, const char *key, bool *inserted) {
+    // Returns the address of key's value, adding a copy of key with a NULL
+    // value if it is absent. The address is valid until the map is next
+    // modified.
+    assert(map != NULL);
+    assert(key != NULL);
+    size_t length = strlen(key);
+    unsigned int h = hash(key, length);
+    if (map->size + 1 > map->capacity * LOAD_FACTOR) {
+        resize(map, map->capacity * GROWTH_FACTOR);
+    }
+    int mask = map->capacity - 1;
+    int i = h & mask;
+    for (; map->slots[i].fill != 0; i = (i + 1) & mask) {
+        STRSLOT *slot = &map->slots[i];
+        if (slot->hash == h && slot->fill == length + 1
+                && memcmp(keyOf(slot), key, length) == 0) {
+            if (inserted != NULL) *inserted = false;
+            return &slot->value;
+        }
+    }
+    STRSLOT *slot = &map->slots[i];
+    slot->hash = h;
+    slot->fill = length + 1;
+    if (length <= STRMAP_INLINE) memcpy(slot->key.bytes, key, length + 1);
+    else {
+        slot->key.heap = malloc(length + 1);
+        assert(slot->key.heap != NULL);
+        memcpy(slot->key.heap, key, length + 1);
+    }
+    slot->value = NULL;
+    map->size++;
+    if (inserted != NULL) *inserted = true;
+    return &slot->value;
+}
+
+void *getSTRMAPvalue(STRMAP *map, const char *key) {
+    assert(map != NULL);
+    assert(key != NULL);
+    size_t length = strlen(key);
+    int i = find(map, key, length, hash(key, length));
+    return i < 0 ? NULL : map->slots[i].value;
+}
+
+bool containsSTRMAPkey(STRMAP *map, const char *key) {
+    assert(map != NULL);
+    assert(key != NULL);
+    size_t length = strlen(key);
+    return find(map, key, length, hash(key, length)) >= 0;
+}
+
+bool removeSTRMAP(STRMAP *map, const char *key) {
+    // Removes key and frees its value; returns false if key was absent.
+    assert(map != NULL);
+    assert(key != NULL);
+    size_t length = strlen(key);
+    int i = find(map, key, length, hash(key, length));
+    if (i < 0) return false;
+    void *value = map->slots[i].value;
+    if (map->slots[i].fill > STRMAP_INLINE + 1) free(map->slots[i].key.heap);
+    // pull later entries of the run back over the hole, skipping any whose
+    // home lies cyclically between the hole and their slot
+    int mask = map->capacity - 1;
+    for (int j = (i + 1) & mask; map->slots[j].fill != 0; j = (j + 1) & mask) {
+        int home = map->slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->slots[i] = map->slots[j];
+            i = j;
+        }
+    }
+    map->slots[i].fill = 0;
+    map->slots[i].value = NULL;
+    map->size--;
+    if (value != NULL && map->freeValue != NULL) map->freeValue(value);
+    return true;
+}
+
+int sizeSTRMAP(STRMAP *map) {
+    assert(map != NULL);
+    return map->size;
+}
+
+void clearSTRMAP(STRMAP *map) {
+    // Empties the map but keeps its capacity.
+    assert(map != NULL);
+    for (int i = 0; i < map->capacity; ++i) {
+        STRSLOT *slot = &map->slots[i];
+        if (slot->fill == 0) continue;
+        if (slot->fill > STRMAP_INLINE + 1) free(slot->key.heap);
+        if (slot->value != NULL && map->freeValue != NULL) map->freeValue(slot->value);
+        slot->fill = 0;
+        slot->value = NULL;
+    }
+    map->size = 0;
+}
+
+void freeSTRMAP(STRMAP *map) {
+    assert(map != NULL);
+    clearSTRMAP(map);
+    free(map->slots);
+    free(map);
+}
+
+
+/********** Private Method Definitions **********/
+
+static unsigned int hash(const char *key, size_t length) {
+    // Mixes the key eight bytes at a time with the splitmix64 finalizer.
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ length;
+    size_t i = 0;
+    for (;; i += 8) {
+        uint64_t chunk = 0;
+        size_t n = length - i < 8 ? length - i : 8;
+        memcpy(&chunk, key + i, n);
+        h ^= chunk;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        h ^= h >> 31;
+        if (n < 8) break;
+    }
+    return (unsigned int)h;
+}
+
+static const char *keyOf(STRSLOT *slot) {
+    return slot->fill > STRMAP_INLINE + 1 ? slot->key.heap : slot->key.bytes;
+}
+
+static int find(STRMAP *map, const char *key, size_t length, unsigned int h) {
+    // Returns the slot holding key, or -1.
+    int mask = map->capacity - 1;
+    for (int i = h & mask; map->slots[i].fill != 0; i = (i + 1) & mask) {
+        STRSLOT *slot = &map->slots[i];
+        if (slot->hash == h && slot->fill == length + 1
+                && memcmp(keyOf(slot), key, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void resize(STRMAP *map, int capacity) {
+    // Moves every slot by its cached hash; no key is hashed again.
+    STRSLOT *old = map->slots;
+    int oldCapacity = map->capacity;
+    map->slots = calloc(capacity, sizeof(STRSLOT));
+    assert(map->slots != NULL);
+    map->capacity = capacity;
+    int mask = capacity - 1;
+    for (int i = 0; i < oldCapacity; ++i) {
+        if (old[i].fill == 0) continue;
+        int j = old[i].hash & mask;
+        while (map->slots[j].fill != 0) j = (j + 1) & mask;
+        map->slots[j] = old[i];
+    }
+    free(old);
+}
@@ -0,0 +1,30 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   strmap.h
+ *  Description: This is the public interface for the string-key map. The
+ *  map keeps its own copy of every key, inline in the table for keys of up
+ *  to STRMAP_INLINE characters, so callers never box a key in a STRING.
+ */
+
+#ifndef __STRMAP_INCLUDED__
+#define __STRMAP_INCLUDED__
+
+#include <stdbool.h>
+
+#define STRMAP_INLINE 23    // longest key stored without a separate allocation
+
+typedef struct STRMAP STRMAP;
+
+extern STRMAP *newSTRMAP(void);
+extern void    setSTRMAPfreeValue(STRMAP *map, void (*free)(void *));
+extern void    reserveSTRMAP(STRMAP *map, int entries);
+extern void    insertSTRMAP(STRMAP *map, const char *key, void *value);
+extern void  **getOrInsertSTRMAP(STRMAP *map, const char *key, bool *inserted);
+extern void   *getSTRMAPvalue(STRMAP *map, const char *key);
+extern bool    containsSTRMAPkey(STRMAP *map, const char *key);
+extern bool    removeSTRMAP(STRMAP *map, const char *key);
+extern int     sizeSTRMAP(STRMAP *map);
+extern void    clearSTRMAP(STRMAP *map);
+extern void    freeSTRMAP(STRMAP *map);
+
+#endif // !__STRMAP_INCLUDED__
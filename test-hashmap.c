@@ -4,25 +4,696 @@
  *  Last Modified:  11 Feb 2020
  */
 
+#define _POSIX_C_SOURCE 200112L
 
+#include "chashmap.h"
+#include "da.h"
 #include "hashmap.h"
 #include "integer.h"
+#include "intern.h"
+#include "intmap.h"
 #include "real.h"
 #include "string.h"
+#include "strmap.h"
+#include "threadpool.h"
+#include "typedhashmap.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
 
 
-int prehashSTRING(void *s) {
-    assert(s != NULL);
-    int strLength = lengthSTRING(s);
-    char *str = getSTRING(s);
-    int result = 0;
-    for (int i = 0; i < strLength; ++i) {
-        result += str[i];
+void testGrowAndShrink(HASHMAPBACKEND backend) {
+    // enough keys to force several incremental rehashes in both directions
+    const int count = 5000;
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, backend);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    for (int i = 0; i < count; ++i) {
+        insertHASHMAP(map, newINTEGER(i), newINTEGER(i * 2));
+    }
+    assert(sizeHASHMAP(map) == count);
+    INTEGER *k = newINTEGER(0);
+    for (int i = 0; i < count; ++i) {
+        setINTEGER(k, i);
+        assert(getINTEGER(getHASHMAPvalue(map, k)) == i * 2);
+    }
+    for (int i = 0; i < count - 10; ++i) {
+        setINTEGER(k, i);
+        freeINTEGER(removeHASHMAP(map, k));
+    }
+    assert(sizeHASHMAP(map) == 10);
+    for (int i = count - 10; i < count; ++i) {
+        setINTEGER(k, i);
+        assert(getINTEGER(getHASHMAPvalue(map, k)) == i * 2);
+    }
+    setINTEGER(k, 0);
+    assert(getHASHMAPvalue(map, k) == NULL);
+    freeINTEGER(k);
+    freeHASHMAP(map);
+    printf("grow and shrink (backend %d): ok\n", backend);
+}
+
+
+static int freedKeys = 0;
+
+void countFreeINTEGER(void *v) {
+    freedKeys++;
+    freeINTEGER(v);
+}
+
+
+void testUpsert(HASHMAPBACKEND backend) {
+    // count 3000 draws from 300 distinct keys, the aggregation pattern
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, backend);
+    setHASHMAPfreeKey(map, countFreeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    for (int i = 0; i < 3000; ++i) {
+        bool inserted;
+        INTEGER *key = newINTEGER((i * 7) % 300);
+        void **count = getOrInsertHASHMAP(map, key, &inserted);
+        if (inserted) *count = newINTEGER(0);
+        else freeINTEGER(key);
+        setINTEGER(*count, getINTEGER(*count) + 1);
+    }
+    assert(sizeHASHMAP(map) == 300);
+    INTEGER *k = newINTEGER(42);
+    assert(getINTEGER(getHASHMAPvalue(map, k)) == 10);
+    // duplicates replace the value instead of piling up; only insertHASHMAP
+    // frees the duplicate key, the other calls leave it with the caller
+    freedKeys = 0;
+    insertHASHMAP(map, newINTEGER(42), newINTEGER(-1));
+    assert(sizeHASHMAP(map) == 300 && freedKeys == 1);
+    assert(getINTEGER(getHASHMAPvalue(map, k)) == -1);
+    INTEGER *duplicate = newINTEGER(42);
+    INTEGER *old = insertOrAssignHASHMAP(map, duplicate, newINTEGER(-2));
+    assert(getINTEGER(old) == -1 && freedKeys == 1);
+    freeINTEGER(old);
+    bool inserted;
+    assert(*getOrInsertHASHMAP(map, duplicate, &inserted) != NULL && !inserted);
+    INTEGER *v = newINTEGER(-3);
+    assert(!insertIfAbsentHASHMAP(map, duplicate, v));
+    assert(freedKeys == 1);
+    freeINTEGER(duplicate);
+    assert(getINTEGER(getHASHMAPvalue(map, k)) == -2);
+    assert(insertIfAbsentHASHMAP(map, newINTEGER(300), v));
+    assert(sizeHASHMAP(map) == 301);
+    freeINTEGER(k);
+    freeHASHMAP(map);
+    printf("upsert (backend %d): ok\n", backend);
+}
+
+
+void testBatch(HASHMAPBACKEND backend) {
+    const int count = 1000;
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, backend);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    void *keys[1000], *values[1000];
+    for (int i = 0; i < count; ++i) {
+        keys[i] = newINTEGER(i);
+        values[i] = newINTEGER(i + 1);
+    }
+    insertHASHMAPbatch(map, keys, values, count);
+    assert(sizeHASHMAP(map) == count);
+    // probe hits and misses in one batch; the second insert reuses keys
+    for (int i = 0; i < count; ++i) keys[i] = newINTEGER(i * 2);
+    getHASHMAPbatch(map, keys, values, count);
+    for (int i = 0; i < count; ++i) {
+        if (i * 2 < count) assert(getINTEGER(values[i]) == i * 2 + 1);
+        else assert(values[i] == NULL);
+        values[i] = newINTEGER(-i);
+    }
+    insertHASHMAPbatch(map, keys, values, count);
+    assert(sizeHASHMAP(map) == count + count / 2);
+    INTEGER *k = newINTEGER(10);
+    assert(getINTEGER(getHASHMAPvalue(map, k)) == -5);
+    freeINTEGER(k);
+    freeHASHMAP(map);
+    printf("batch (backend %d): ok\n", backend);
+}
+
+
+void testReserve(HASHMAPBACKEND backend) {
+    HASHMAP *map = newHASHMAPreserved(prehashINTEGER, compareINTEGER, backend, 2000);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    reserveHASHMAP(map, 4000);
+    for (int i = 0; i < 4000; ++i) insertHASHMAP(map, newINTEGER(i), newINTEGER(i));
+    INTEGER *k = newINTEGER(0);
+    for (int i = 0; i < 3990; ++i) {
+        setINTEGER(k, i);
+        freeINTEGER(removeHASHMAP(map, k));
+    }
+    shrinkToFitHASHMAP(map);
+    assert(sizeHASHMAP(map) == 10);
+    for (int i = 3990; i < 4000; ++i) {
+        setINTEGER(k, i);
+        assert(getINTEGER(getHASHMAPvalue(map, k)) == i);
+    }
+    freeINTEGER(k);
+    freeHASHMAP(map);
+    printf("reserve (backend %d): ok\n", backend);
+}
+
+
+void testIntMap(void) {
+    INTMAP *map = newINTMAP();
+    setINTMAPfreeValue(map, freeINTEGER);
+    // strided keys collide in a naive table; key 0 lives beside the slots
+    for (int64_t i = 0; i < 5000; ++i) insertINTMAP(map, i * 1024, newINTEGER(i));
+    insertINTMAP(map, 1024, newINTEGER(-1));
+    assert(sizeINTMAP(map) == 5000);
+    assert(getINTEGER(getINTMAPvalue(map, 1024)) == -1);
+    for (int64_t i = 0; i < 5000; i += 2) {
+        bool removed = removeINTMAP(map, i * 1024);
+        assert(removed);
+    }
+    bool removed = removeINTMAP(map, 0);
+    assert(!removed);
+    assert(sizeINTMAP(map) == 2500);
+    for (int64_t i = 3; i < 5000; i += 2) {
+        assert(getINTEGER(getINTMAPvalue(map, i * 1024)) == i);
+        assert(!containsINTMAPkey(map, (i - 1) * 1024));
+    }
+    bool inserted;
+    void **count = getOrInsertINTMAP(map, INT64_MIN, &inserted);
+    assert(inserted && *count == NULL);
+    freeINTMAP(map);
+    printf("intmap: ok\n");
+}
+
+
+void testStrMap(void) {
+    STRMAP *map = newSTRMAP();
+    setSTRMAPfreeValue(map, freeINTEGER);
+    char key[48];
+    for (int i = 0; i < 3000; ++i) {
+        // every third key is too long to be stored inline
+        sprintf(key, i % 3 ? "k%d" : "a-rather-long-key-number-%d", i);
+        insertSTRMAP(map, key, newINTEGER(i));
+    }
+    assert(sizeSTRMAP(map) == 3000);
+    for (int i = 0; i < 3000; i += 2) {
+        sprintf(key, i % 3 ? "k%d" : "a-rather-long-key-number-%d", i);
+        bool removed = removeSTRMAP(map, key);
+        assert(removed);
+    }
+    for (int i = 1; i < 3000; i += 2) {
+        sprintf(key, i % 3 ? "k%d" : "a-rather-long-key-number-%d", i);
+        assert(getINTEGER(getSTRMAPvalue(map, key)) == i);
+    }
+    assert(!containsSTRMAPkey(map, "k0") && !containsSTRMAPkey(map, ""));
+    insertSTRMAP(map, "", NULL);
+    assert(containsSTRMAPkey(map, "") && sizeSTRMAP(map) == 1501);
+    freeSTRMAP(map);
+    printf("strmap: ok\n");
+}
+
+
+static inline unsigned int hashInt(int key) { return (unsigned int)key; }
+static inline bool equalsInt(int a, int b) { return a == b; }
+
+DEFINE_HASHMAP(COUNTS, int, long, hashInt, equalsInt)
+
+void testTypedMap(void) {
+    COUNTS *map = newCOUNTS();
+    for (int i = 0; i < 10000; ++i) ++*getOrInsertCOUNTS(map, i % 700, NULL);
+    assert(sizeCOUNTS(map) == 700);
+    assert(*getCOUNTSvalue(map, 42) == 15);
+    for (int i = 0; i < 700; i += 2) assert(removeCOUNTS(map, i, NULL));
+    long count;
+    assert(!removeCOUNTS(map, 0, &count) && removeCOUNTS(map, 1, &count) && count == 15);
+    assert(!containsCOUNTSkey(map, 42) && *getCOUNTSvalue(map, 43) == 15);
+    // a re-added key starts from a zero value again
+    bool inserted;
+    assert(*getOrInsertCOUNTS(map, 42, &inserted) == 0 && inserted);
+    freeCOUNTS(map);
+    printf("typed map: ok\n");
+}
+
+
+void testString(void) {
+    // slices of one buffer, none of them NUL-terminated
+    char frame[] = "var0var1var10";
+    STRING *a = newSTRINGlength(frame + 4, 4);
+    STRING *b = newSTRING("var1");
+    STRING *c = newSTRINGlength(frame + 8, 5);
+    assert(lengthSTRING(a) == 4 && equalsSTRING(a, b));
+    assert(prehashSTRING(a) == prehashSTRING(b));
+    assert(!equalsSTRING(b, c) && compareSTRING(b, c) < 0 && rcompareSTRING(b, c) > 0);
+    assert(compareSTRINGequality(a, b) == 0 && compareSTRINGequality(b, c) != 0);
+    HASHMAP *map = newHASHMAP(prehashSTRING, compareSTRINGequality);
+    insertHASHMAP(map, b, NULL);
+    assert(insertIfAbsentHASHMAP(map, c, NULL) && !insertIfAbsentHASHMAP(map, a, NULL));
+    freeHASHMAP(map);
+    freeSTRING(a);
+    freeSTRING(b);
+    freeSTRING(c);
+    printf("string: ok\n");
+}
+
+
+void testIntern(void) {
+    INTERN *strings = newINTERN();
+    char frame[] = "cpu.user cpu.idle cpu.user";
+    STRING *user = internSTRINGlength(strings, frame, 8);
+    assert(internSTRINGlength(strings, frame + 18, 8) == user);
+    assert(internSTRING(strings, "cpu.user") == user);
+    assert(lookupINTERN(strings, "mem", 3) == NULL && sizeINTERN(strings) == 1);
+    // interned keys need no comparator: equal strings are the same pointer
+    HASHMAP *totals = newHASHMAP(prehashSTRING, NULL);
+    setHASHMAPfreeValue(totals, freeINTEGER);
+    char *metrics[] = {"cpu.user", "cpu.idle", "mem.free", "cpu.user", "cpu.idle", "cpu.user"};
+    for (int i = 0; i < 6; ++i) {
+        bool inserted;
+        void **total = getOrInsertHASHMAP(totals, internSTRING(strings, metrics[i]), &inserted);
+        if (inserted) *total = newINTEGER(0);
+        setINTEGER(*total, getINTEGER(*total) + 1);
+    }
+    assert(sizeHASHMAP(totals) == 3 && sizeINTERN(strings) == 3);
+    assert(getINTEGER(getHASHMAPvalue(totals, user)) == 3);
+    freeHASHMAP(totals);
+    freeINTERN(strings);
+    printf("intern: ok\n");
+}
+
+
+void sumEntry(void *key, void *value, void *total) {
+    (void)key;
+    *(long *)total += getINTEGER(value);
+}
+
+
+void testIterate(HASHMAPBACKEND backend) {
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, backend);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    // 1000 entries leave a rehash in flight for forEachHASHMAP to span
+    for (int i = 0; i < 1000; ++i) insertHASHMAP(map, newINTEGER(i), newINTEGER(i));
+    long total = 0;
+    forEachHASHMAP(map, sumEntry, &total);
+    assert(total == 999 * 1000 / 2);
+    // drop the odd keys while walking
+    HASHMAPITER iter;
+    int visited = 0;
+    for (bool more = firstHASHMAP(map, &iter); more; more = nextHASHMAP(&iter)) {
+        visited++;
+        assert(getINTEGER(keyHASHMAPiter(&iter)) == getINTEGER(valueHASHMAPiter(&iter)));
+        if (getINTEGER(keyHASHMAPiter(&iter)) % 2) freeINTEGER(removeHASHMAPiter(&iter));
+    }
+    assert(visited == 1000 && sizeHASHMAP(map) == 500);
+    total = 0;
+    forEachHASHMAP(map, sumEntry, &total);
+    assert(total == 998 * 500 / 2);
+    freeHASHMAP(map);
+    printf("iterate (backend %d): ok\n", backend);
+}
+
+
+void testNodePool(void) {
+    HASHMAP *map = newHASHMAP(prehashINTEGER, compareINTEGER);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPnodePool(map, true);
+    INTEGER *keys[1000];
+    for (int i = 0; i < 1000; ++i) {
+        keys[i] = newINTEGER(i);
+        insertHASHMAP(map, keys[i], NULL);
+    }
+    for (int i = 0; i < 500; ++i) {
+        freeINTEGER(removeHASHMAP(map, keys[i]));
+    }
+    SLABSTATS stats;
+    assert(statsHASHMAPpool(map, &stats));
+    assert(stats.blocksInUse == 500);
+    printf("node pool: %d slabs, %ld/%ld blocks in use, %d bytes per entry\n",
+            stats.slabs, stats.blocksInUse, stats.blocks, stats.blockSize);
+    clearHASHMAP(map);
+    assert(statsHASHMAPpool(map, &stats) && stats.slabs == 0);
+    freeHASHMAP(map);
+}
+
+
+void sumEntryAtomic(void *key, void *value, void *total) {
+    (void)key;
+    __atomic_add_fetch((long *)total, getINTEGER(value), __ATOMIC_RELAXED);
+}
+
+
+void testParallel(HASHMAPBACKEND backend, THREADPOOL *pool) {
+    // 30000 keys over 20000 distinct values, so workers also see duplicates;
+    // the later copy of a key wins, as with insertHASHMAPbatch
+    const int count = 30000;
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, backend);
+    if (backend == HASHMAP_CHAINED) setHASHMAPnodePool(map, true);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    void **keys = malloc(sizeof(void *) * count);
+    void **values = malloc(sizeof(void *) * count);
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < count; ++i) {
+            keys[i] = newINTEGER(i % 20000);
+            values[i] = newINTEGER(i);
+        }
+        buildHASHMAPparallel(map, pool, keys, values, count);
+        assert(sizeHASHMAP(map) == 20000);
+        long total = 0;
+        forEachHASHMAPparallel(map, pool, sumEntryAtomic, &total);
+        assert(total == (long)(20000 + 29999) * 10000 / 2 + (long)(10000 + 19999) * 10000 / 2);
+        INTEGER *k = newINTEGER(5);
+        assert(getINTEGER(getHASHMAPvalue(map, k)) == 20005);
+        freeINTEGER(k);
+        if (round == 0) clearHASHMAPparallel(map, pool);
+    }
+    assert(sizeHASHMAP(map) == 20000);
+    freeHASHMAPparallel(map, pool);
+    // each STRING key object appears twice, unhashed, in different workers'
+    // shares of the keys, so two workers fill in its cached hash at once
+    HASHMAP *strings = newHASHMAPbackend(prehashSTRING, compareSTRINGequality, backend);
+    setHASHMAPfreeKey(strings, freeSTRING);
+    setHASHMAPfreeValue(strings, freeINTEGER);
+    char (*text)[16] = malloc(sizeof(*text) * 10000);
+    for (int i = 0; i < 10000; ++i) {
+        sprintf(text[i], "key-%d", i);
+        keys[i] = keys[i + 10000] = newSTRING(text[i]);
+        values[i] = newINTEGER(i);
+        values[i + 10000] = newINTEGER(-i);
+    }
+    buildHASHMAPparallel(strings, pool, keys, values, 20000);
+    assert(sizeHASHMAP(strings) == 10000);
+    STRING *s = newSTRING("key-1234");
+    assert(getINTEGER(getHASHMAPvalue(strings, s)) == -1234);
+    freeSTRING(s);
+    freeHASHMAPparallel(strings, pool);
+    free(text);
+    free(keys);
+    free(values);
+    printf("parallel (backend %d): ok\n", backend);
+}
+
+
+uint64_t readSnapshotWord(const char *path, long at) {
+    FILE *fp = fopen(path, "rb");
+    assert(fp != NULL);
+    uint64_t word = 0;
+    int seek = fseek(fp, at, SEEK_SET);
+    size_t read = fread(&word, sizeof(word), 1, fp);
+    fclose(fp);
+    assert(seek == 0 && read == 1);
+    return word;
+}
+
+void rejectCorruptSnapshot(HASHMAP *map, const char *path, long at, uint64_t word) {
+    // saves map afresh, overwrites the eight bytes at offset at with word,
+    // and checks that neither kind of load accepts the file
+    bool saved = saveHASHMAP(map, path);
+    assert(saved);
+    FILE *fp = fopen(path, "r+b");
+    assert(fp != NULL);
+    int seek = fseek(fp, at, SEEK_SET);
+    size_t written = fwrite(&word, sizeof(word), 1, fp);
+    fclose(fp);
+    assert(seek == 0 && written == 1);
+    assert(loadHASHMAPview(path, prehashSTRING, encodeSTRING) == NULL);
+    HASHMAP *copy = newHASHMAP(prehashSTRING, compareSTRING);
+    setHASHMAPkeyCodec(copy, encodeSTRING, decodeSTRING);
+    setHASHMAPvalueCodec(copy, encodeINTEGER, decodeINTEGER);
+    bool loaded = loadHASHMAP(copy, path);
+    assert(!loaded && sizeHASHMAP(copy) == 0);
+    freeHASHMAP(copy);
+}
+
+void testSnapshot(HASHMAPBACKEND backend) {
+    const char *path = "test-hashmap.snapshot";
+    HASHMAP *map = newHASHMAPbackend(prehashSTRING, compareSTRING, backend);
+    setHASHMAPfreeKey(map, freeSTRING);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    setHASHMAPkeyCodec(map, encodeSTRING, decodeSTRING);
+    setHASHMAPvalueCodec(map, encodeINTEGER, decodeINTEGER);
+    char text[2000][16];
+    for (int i = 0; i < 2000; ++i) {
+        sprintf(text[i], "key-%d", i);
+        // every tenth value is NULL
+        insertHASHMAP(map, newSTRING(text[i]), i % 10 ? newINTEGER(i) : NULL);
     }
-    printf("result: %d\n", result);
-    return result;
+    bool saved = saveHASHMAP(map, path);
+    assert(saved);
+    HASHMAPVIEW *view = loadHASHMAPview(path, prehashSTRING, encodeSTRING);
+    assert(view != NULL && sizeHASHMAPVIEW(view) == 2000);
+    STRING *k = newSTRING("key-0");
+    for (int i = 0; i < 2000; ++i) {
+        setSTRING(k, text[i]);
+        size_t length;
+        const int *value = getHASHMAPVIEWvalue(view, k, &length);
+        assert(containsHASHMAPVIEWkey(view, k));
+        if (i % 10) assert(value != NULL && length == sizeof(int) && *value == i);
+        else assert(value == NULL);
+    }
+    setSTRING(k, "key-2000");
+    assert(!containsHASHMAPVIEWkey(view, k));
+    freeHASHMAPVIEW(view);
+    // decode into a map of every backend, the saving one included
+    for (int target = HASHMAP_CHAINED; target <= HASHMAP_SWISS; ++target) {
+        HASHMAP *copy = newHASHMAPbackend(prehashSTRING, compareSTRING, target);
+        setHASHMAPfreeKey(copy, freeSTRING);
+        setHASHMAPfreeValue(copy, freeINTEGER);
+        setHASHMAPkeyCodec(copy, encodeSTRING, decodeSTRING);
+        setHASHMAPvalueCodec(copy, encodeINTEGER, decodeINTEGER);
+        bool loaded = loadHASHMAP(copy, path);
+        assert(loaded && sizeHASHMAP(copy) == 2000);
+        setSTRING(k, "key-1234");
+        assert(getINTEGER(getHASHMAPvalue(copy, k)) == 1234);
+        setSTRING(k, "key-10");
+        assert(containsKey(copy, k) && getHASHMAPvalue(copy, k) == NULL);
+        freeHASHMAP(copy);
+    }
+    freeSTRING(k);
+    // offsets that run past the end of the file, aligned so that only the
+    // bounds checks can catch them, and large enough to wrap when added
+    // to; the header keeps the bucket starts 24 bytes in and the entry
+    // array's offset 32 bytes in, and an entry its key offset 16 bytes in
+    const uint64_t huge = UINT64_MAX - 7;
+    rejectCorruptSnapshot(map, path, readSnapshotWord(path, 32) + 16, huge);
+    rejectCorruptSnapshot(map, path, 24, huge);
+    rejectCorruptSnapshot(map, path, 32, huge);
+    freeHASHMAP(map);
+    remove(path);
+    assert(loadHASHMAPview(path, prehashSTRING, encodeSTRING) == NULL);
+    printf("snapshot (backend %d): ok\n", backend);
+}
+
+
+void testStats(HASHMAPBACKEND backend) {
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, backend);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    for (int i = 0; i < 1000; ++i) insertHASHMAP(map, newINTEGER(i), newINTEGER(i));
+    INTEGER *k = newINTEGER(0);
+    // 1000 hits and 100 misses, then 100 removals
+    for (int i = 0; i < 1100; ++i) {
+        setINTEGER(k, i);
+        getHASHMAPvalue(map, k);
+    }
+    for (int i = 0; i < 100; ++i) {
+        setINTEGER(k, i);
+        freeINTEGER(removeHASHMAP(map, k));
+    }
+    freeINTEGER(k);
+    HASHMAPSTATS stats;
+    statsHASHMAP(map, &stats);
+    long measured = 0;
+    for (int i = 0; i < HASHMAP_PROBE_ROWS; ++i) measured += stats.probes[i];
+    assert(measured == 900);
+    assert(stats.longestProbe >= 1 && stats.bytes > 0);
+#if !defined(HASHMAP_NO_STATS)
+    assert(stats.gets == 1100 && stats.hits == 1000 && stats.misses == 100);
+    assert(stats.inserts == 1000 && stats.removes == 100);
+    assert(stats.prehashes == 2200 && stats.compares >= 1100);
+    assert(stats.resizes > 0 && stats.rehashSteps > 0 && stats.resizeSeconds > 0);
+#endif
+    freeHASHMAP(map);
+    printf("stats (backend %d): longest probe %d, %zu bytes\n", backend,
+            stats.longestProbe, stats.bytes);
+}
+
+
+void testTrace(void) {
+    // a ring of 4 keeps the last four of the seven events below
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, HASHMAP_LINEAR_PROBING);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    HASHMAPTRACER *tracer = newHASHMAPTRACER(3);
+    setHASHMAPtrace(map, recordHASHMAPTRACER, tracer);
+    INTEGER *k = newINTEGER(1);
+    insertHASHMAP(map, newINTEGER(1), NULL);
+    insertHASHMAP(map, newINTEGER(2), NULL);
+    assert(containsKey(map, k));
+    setINTEGER(k, 3);
+    assert(!containsKey(map, k));
+    setINTEGER(k, 1);
+    freeINTEGER(removeHASHMAP(map, k));
+    reserveHASHMAP(map, 100);
+    assert(getHASHMAPvalue(map, k) == NULL);
+    assert(countHASHMAPTRACER(tracer) == 7 && sizeHASHMAPTRACER(tracer) == 4);
+    HASHMAPEVENT expected[] = {HASHMAP_TRACE_PROBE, HASHMAP_TRACE_REMOVE,
+            HASHMAP_TRACE_RESIZE, HASHMAP_TRACE_PROBE};
+    HASHMAPTRACE event;
+    for (int i = 0; i < 4; ++i) {
+        assert(getHASHMAPTRACERevent(tracer, i, &event));
+        assert(event.event == expected[i]);
+    }
+    assert(!event.found && event.key == k && event.capacity >= 128);
+    assert(!getHASHMAPTRACERevent(tracer, 4, &event));
+    displayHASHMAPTRACER(tracer, stdout);
+    // without a callback nothing more is recorded
+    setHASHMAPtrace(map, NULL, NULL);
+    insertHASHMAP(map, newINTEGER(3), NULL);
+    assert(countHASHMAPTRACER(tracer) == 7);
+    freeINTEGER(k);
+    freeHASHMAP(map);
+    freeHASHMAPTRACER(tracer);
+    printf("trace: ok\n");
+}
+
+
+void testDA(void) {
+    // values are small integers stored as pointers
+    int values[64];
+    for (int i = 0; i < 64; ++i) values[i] = i;
+    DA *items = newDA();
+    // pushing at both ends wraps the ring around the end of its store
+    for (int i = 32; i < 48; ++i) insertDAback(items, &values[i]);
+    for (int i = 31; i >= 16; --i) insertDAfront(items, &values[i]);
+    insertDA(items, 5, &values[0]);
+    insertDA(items, 30, &values[1]);
+    assert(removeDA(items, 30) == &values[1] && removeDA(items, 5) == &values[0]);
+    for (int i = 0; i < 32; ++i) assert(getDA(items, i) == &values[16 + i]);
+    assert(removeDAback(items) == &values[47] && removeDAfront(items) == &values[16]);
+    // unionDA moves the donor's values in order and leaves it empty
+    DA *donor = newDAfilled(4, NULL);
+    void *more[] = {&values[48], &values[49], &values[50]};
+    appendDA(donor, more, 3);
+    assert(removeDAfront(donor) == NULL && sizeDA(donor) == 6);
+    unionDA(items, donor);
+    assert(sizeDA(donor) == 0 && sizeDA(items) == 36);
+    assert(getDA(items, 29) == &values[46] && getDA(items, 30) == NULL);
+    assert(getDA(items, 35) == &values[50]);
+    while (sizeDA(items) > 0) removeDAback(items);
+    reserveDA(items, 100);
+    freeDA(donor);
+    freeDA(items);
+    printf("da: ok\n");
+}
+
+
+void testDump(THREADPOOL *pool) {
+    // 20000 records span several blocks; the restore runs serially and
+    // with the reader overlapped, then once more from a damaged stream
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, HASHMAP_SWISS);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    setHASHMAPfreeValue(map, freeINTEGER);
+    setHASHMAPkeyCodec(map, encodeINTEGER, decodeINTEGER);
+    setHASHMAPvalueCodec(map, encodeINTEGER, decodeINTEGER);
+    for (int i = 0; i < 20000; ++i) insertHASHMAP(map, newINTEGER(i), i % 10 ? newINTEGER(-i) : NULL);
+    FILE *fp = tmpfile();
+    assert(fp != NULL);
+    bool dumped = dumpHASHMAP(map, fileno(fp));
+    assert(dumped);
+    freeHASHMAP(map);
+    INTEGER *k = newINTEGER(0);
+    for (int round = 0; round < 3; ++round) {
+        map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, HASHMAP_CHAINED);
+        setHASHMAPfreeKey(map, freeINTEGER);
+        setHASHMAPfreeValue(map, freeINTEGER);
+        setHASHMAPkeyCodec(map, encodeINTEGER, decodeINTEGER);
+        setHASHMAPvalueCodec(map, encodeINTEGER, decodeINTEGER);
+        if (round == 2) {
+            // flip a byte in the middle of the stream
+            fseek(fp, 100000, SEEK_SET);
+            int c = fgetc(fp);
+            fseek(fp, 100000, SEEK_SET);
+            fputc(c ^ 0x55, fp);
+            fflush(fp);
+        }
+        lseek(fileno(fp), 0, SEEK_SET);
+        bool ok = restoreHASHMAP(map, fileno(fp), round == 0 ? NULL : pool);
+        if (round < 2) {
+            assert(ok && sizeHASHMAP(map) == 20000);
+            for (int i = 0; i < 20000; i += 7) {
+                setINTEGER(k, i);
+                void *value = getHASHMAPvalue(map, k);
+                assert(i % 10 ? getINTEGER(value) == -i : value == NULL);
+            }
+        }
+        else assert(!ok && sizeHASHMAP(map) < 20000);
+        freeHASHMAP(map);
+    }
+    freeINTEGER(k);
+    fclose(fp);
+    printf("dump: ok\n");
+}
+
+
+void *churnCHASHMAP(void *map) {
+    // each writer owns keys congruent to its id modulo 4; values are freed
+    // by the map once no reader can reach them
+    static int nextId = 0;
+    int id = __atomic_fetch_add(&nextId, 1, __ATOMIC_RELAXED);
+    INTEGER *probe = newINTEGER(0);
+    for (int round = 0; round < 3; ++round) {
+        for (int i = id; i < 4000; i += 4) {
+            insertCHASHMAP(map, newINTEGER(i), newINTEGER(i));
+            setINTEGER(probe, (i * 7) % 4000);
+            INTEGER *value;
+            enterCHASHMAP(map);
+            if ((value = getCHASHMAPvalue(map, probe)) != NULL) {
+                assert(getINTEGER(value) == getINTEGER(probe));
+            }
+            exitCHASHMAP(map);
+        }
+        for (int i = id; i < 4000; i += 4) {
+            setINTEGER(probe, i);
+            if (round == 2) continue;
+            bool removed = removeCHASHMAP(map, probe);
+            assert(removed);
+        }
+    }
+    freeINTEGER(probe);
+    return NULL;
+}
+
+
+void testConcurrent(void) {
+    CHASHMAP *map = newCHASHMAP(prehashINTEGER, compareINTEGER);
+    setCHASHMAPfreeKey(map, freeINTEGER);
+    setCHASHMAPfreeValue(map, freeINTEGER);
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, churnCHASHMAP, map);
+    }
+    for (int i = 0; i < 4; ++i) pthread_join(threads[i], NULL);
+    assert(sizeCHASHMAP(map) == 4000);
+    // the map grew while the writers ran; every key must have moved along
+    INTEGER *k = newINTEGER(0);
+    for (int i = 0; i < 4000; ++i) {
+        setINTEGER(k, i);
+        assert(getINTEGER(getCHASHMAPvalue(map, k)) == i);
+    }
+    freeINTEGER(k);
+    freeCHASHMAP(map);
+    printf("concurrent: ok\n");
+}
+
+
+void testDistribution(void) {
+    // sequential keys used to collide under the old multiplicative hash
+    HASHMAP *map = newHASHMAPbackend(prehashINTEGER, compareINTEGER, HASHMAP_LINEAR_PROBING);
+    setHASHMAPfreeKey(map, freeINTEGER);
+    for (int i = 0; i < 1000; ++i) {
+        insertHASHMAP(map, newINTEGER(i * 64), NULL);
+    }
+    displayHASHMAPdistribution(map, stdout);
+    freeHASHMAP(map);
 }
 
 
@@ -61,5 +732,42 @@ int main(void) {
     freeSTRING(f0);
     printf("\n");
     freeHASHMAP(map);
+    testGrowAndShrink(HASHMAP_CHAINED);
+    testGrowAndShrink(HASHMAP_LINEAR_PROBING);
+    testGrowAndShrink(HASHMAP_SWISS);
+    testUpsert(HASHMAP_CHAINED);
+    testUpsert(HASHMAP_LINEAR_PROBING);
+    testUpsert(HASHMAP_SWISS);
+    testBatch(HASHMAP_CHAINED);
+    testBatch(HASHMAP_LINEAR_PROBING);
+    testBatch(HASHMAP_SWISS);
+    testReserve(HASHMAP_CHAINED);
+    testReserve(HASHMAP_LINEAR_PROBING);
+    testReserve(HASHMAP_SWISS);
+    testIntMap();
+    testStrMap();
+    testIterate(HASHMAP_CHAINED);
+    testIterate(HASHMAP_LINEAR_PROBING);
+    testIterate(HASHMAP_SWISS);
+    testTypedMap();
+    testString();
+    testIntern();
+    testNodePool();
+    testConcurrent();
+    testStats(HASHMAP_CHAINED);
+    testStats(HASHMAP_LINEAR_PROBING);
+    testStats(HASHMAP_SWISS);
+    testTrace();
+    testDA();
+    THREADPOOL *pool = newTHREADPOOL(4);
+    testParallel(HASHMAP_CHAINED, pool);
+    testParallel(HASHMAP_LINEAR_PROBING, pool);
+    testParallel(HASHMAP_SWISS, pool);
+    testDump(pool);
+    freeTHREADPOOL(pool);
+    testSnapshot(HASHMAP_CHAINED);
+    testSnapshot(HASHMAP_LINEAR_PROBING);
+    testSnapshot(HASHMAP_SWISS);
+    testDistribution();
     return 0;
 }
@@ -0,0 +1,159 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   threadpool.c
+ *  Description: This is the implementation file for the thread pool.
+ *
+ *  Workers sleep on a condition variable until runTHREADPOOL bumps the job
+ *  generation, run the posted task once and report back; the last one to
+ *  finish wakes the caller, which has meanwhile run worker 0's share itself.
+ *  Jobs from different callers are serialised, one job at a time.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "threadpool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+/********** Global Constants **********/
+#define MAX_WORKERS 256
+
+
+/********** Thread Pool Struct **********/
+
+struct THREADPOOL {
+    int workers;            // pool threads plus the calling thread
+    pthread_t *threads;
+
+    pthread_mutex_t run;    // held for the whole of a job
+    pthread_mutex_t lock;   // guards the fields below
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;   // bumped once per job
+    int pending;                // pool threads still running the job
+    bool shutdown;
+    void (*task)(void *, int, int);
+    void *ctx;
+};
+
+
+/********** Worker Struct **********/
+
+typedef struct worker {
+    THREADPOOL *pool;
+    int index;
+} WORKER;
+
+
+/********** Private Method Prototypes **********/
+static void *work(void *arg);
+
+
+/********** Public Method Definitions **********/
+
+THREADPOOL *newTHREADPOOL(int threads) {
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+    THREADPOOL *pool = malloc(sizeof(THREADPOOL));
+    assert(pool != NULL);
+    pool->workers = threads;
+    pool->threads = malloc(sizeof(pthread_t) * threads);
+    assert(pool->threads != NULL);
+    pthread_mutex_init(&pool->run, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->shutdown = false;
+    pool->task = NULL;
+    pool->ctx = NULL;
+    // worker 0 is whichever thread calls runTHREADPOOL
+    for (int i = 1; i < threads; ++i) {
+        WORKER *worker = malloc(sizeof(WORKER));
+        assert(worker != NULL);
+        worker->pool = pool;
+        worker->index = i;
+        int rc = pthread_create(&pool->threads[i], NULL, work, worker);
+        assert(rc == 0);
+        (void)rc;
+    }
+    return pool;
+}
+
+int sizeTHREADPOOL(THREADPOOL *pool) {
+    assert(pool != NULL);
+    return pool->workers;
+}
+
+void runTHREADPOOL(THREADPOOL *pool, void (*task)(void *, int, int), void *ctx) {
+    // Calls task(ctx, worker, workers) once for every worker in 0..workers-1
+    // and returns when all of them have finished.
+    assert(pool != NULL);
+    assert(task != NULL);
+    pthread_mutex_lock(&pool->run);
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->pending = pool->workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    task(ctx, 0, pool->workers);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pool->task = NULL;
+    pool->ctx = NULL;
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run);
+}
+
+void freeTHREADPOOL(THREADPOOL *pool) {
+    assert(pool != NULL);
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->workers; ++i) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run);
+    free(pool->threads);
+    free(pool);
+}
+
+
+/********** Private Method Definitions **********/
+
+static void *work(void *arg) {
+    WORKER *worker = arg;
+    THREADPOOL *pool = worker->pool;
+    int index = worker->index;
+    free(worker);
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        void (*task)(void *, int, int) = pool->task;
+        void *ctx = pool->ctx;
+        pthread_mutex_unlock(&pool->lock);
+        task(ctx, index, pool->workers);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
@@ -0,0 +1,22 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   threadpool.h
+ *  Description: This is the public interface for the thread pool. A pool
+ *  keeps a fixed set of worker threads parked between jobs and runs one
+ *  fork-join job at a time: every worker, including the calling thread,
+ *  runs the job's task once with its own worker number.
+ */
+
+#ifndef __THREADPOOL_INCLUDED__
+#define __THREADPOOL_INCLUDED__
+
+typedef struct THREADPOOL THREADPOOL;
+
+// threads <= 0 uses one worker per online processor
+extern THREADPOOL *newTHREADPOOL(int threads);
+extern int         sizeTHREADPOOL(THREADPOOL *pool);
+extern void        runTHREADPOOL(THREADPOOL *pool,
+                        void (*task)(void *ctx, int worker, int workers), void *ctx);
+extern void        freeTHREADPOOL(THREADPOOL *pool);
+
+#endif // !__THREADPOOL_INCLUDED__
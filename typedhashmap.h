@@ -0,0 +1,174 @@
+/*
+ *  Author: Brett Heithold
+ *  File:   typedhashmap.h
+ *  Description: Header-only, type-specialised hash maps. Instantiating
+ *
+ *      DEFINE_HASHMAP(COUNTS, int, long, hashInt, equalsInt)
+ *
+ *  declares a COUNTS type and static inline functions newCOUNTS,
+ *  insertCOUNTS, getCOUNTSvalue and friends. Keys and values are stored by
+ *  value in the slots and hashfn and eqfn are called directly, so the
+ *  compiler can inline the whole probe loop. hashfn takes a key and returns
+ *  an unsigned int; eqfn takes two keys and returns nonzero when they are
+ *  equal. The generic HASHMAP remains the choice for heterogeneous keys.
+ *
+ *  The table is a power-of-two slot array probed linearly. A slot's cached
+ *  hash always has its top bit set, so a zero hash marks an empty slot, and
+ *  removal shifts the probe run back instead of leaving tombstones.
+ */
+
+#ifndef __TYPEDHASHMAP_INCLUDED__
+#define __TYPEDHASHMAP_INCLUDED__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define TYPEDHASHMAP_INITIAL_CAPACITY 16
+#define TYPEDHASHMAP_LOAD_FACTOR 0.75
+
+// murmur3 fmix32, so weak user hashes still spread over the index bits
+static inline unsigned int mixTYPEDHASHMAP(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h | 0x80000000u;
+}
+
+#define DEFINE_HASHMAP(name, KeyT, ValT, hashfn, eqfn)                          \
+                                                                                \
+typedef struct name##slot {                                                     \
+    unsigned int hash;      /* 0 marks an empty slot */                         \
+    KeyT key;                                                                   \
+    ValT value;                                                                 \
+} name##SLOT;                                                                   \
+                                                                                \
+typedef struct name {                                                           \
+    int size;                                                                   \
+    int capacity;                                                               \
+    name##SLOT *slots;                                                          \
+} name;                                                                         \
+                                                                                \
+static inline name *new##name(void) {                                           \
+    name *map = malloc(sizeof(name));                                           \
+    assert(map != NULL);                                                        \
+    map->size = 0;                                                              \
+    map->capacity = TYPEDHASHMAP_INITIAL_CAPACITY;                              \
+    map->slots = calloc(map->capacity, sizeof(name##SLOT));                     \
+    assert(map->slots != NULL);                                                 \
+    return map;                                                                 \
+}                                                                               \
+                                                                                \
+static inline void resize##name(name *map, int capacity) {                      \
+    /* moves every slot by its cached hash; no key is hashed again */           \
+    name##SLOT *old = map->slots;                                               \
+    int oldCapacity = map->capacity;                                            \
+    map->slots = calloc(capacity, sizeof(name##SLOT));                          \
+    assert(map->slots != NULL);                                                 \
+    map->capacity = capacity;                                                   \
+    for (int i = 0; i < oldCapacity; ++i) {                                     \
+        if (old[i].hash == 0) continue;                                         \
+        int j = old[i].hash & (capacity - 1);                                   \
+        while (map->slots[j].hash != 0) j = (j + 1) & (capacity - 1);           \
+        map->slots[j] = old[i];                                                 \
+    }                                                                           \
+    free(old);                                                                  \
+}                                                                               \
+                                                                                \
+static inline void reserve##name(name *map, int entries) {                      \
+    assert(map != NULL);                                                        \
+    int capacity = map->capacity;                                               \
+    while (capacity * TYPEDHASHMAP_LOAD_FACTOR < entries) capacity *= 2;        \
+    if (capacity > map->capacity) resize##name(map, capacity);                  \
+}                                                                               \
+                                                                                \
+static inline int find##name(name *map, KeyT key) {                             \
+    /* returns the slot holding key, or -1 */                                   \
+    unsigned int h = mixTYPEDHASHMAP(hashfn(key));                              \
+    int mask = map->capacity - 1;                                               \
+    for (int i = h & mask; map->slots[i].hash != 0; i = (i + 1) & mask) {       \
+        if (map->slots[i].hash == h && eqfn(map->slots[i].key, key)) return i;  \
+    }                                                                           \
+    return -1;                                                                  \
+}                                                                               \
+                                                                                \
+static inline ValT *getOrInsert##name(name *map, KeyT key, bool *inserted) {    \
+    /* Returns the address of key's value, adding key with a zeroed value */    \
+    /* if it is absent. Valid until the map is next modified. */                \
+    assert(map != NULL);                                                        \
+    if (map->size + 1 > map->capacity * TYPEDHASHMAP_LOAD_FACTOR) {             \
+        resize##name(map, map->capacity * 2);                                   \
+    }                                                                           \
+    unsigned int h = mixTYPEDHASHMAP(hashfn(key));                              \
+    int mask = map->capacity - 1;                                               \
+    int i = h & mask;                                                           \
+    for (; map->slots[i].hash != 0; i = (i + 1) & mask) {                       \
+        if (map->slots[i].hash == h && eqfn(map->slots[i].key, key)) {          \
+            if (inserted != NULL) *inserted = false;                            \
+            return &map->slots[i].value;                                        \
+        }                                                                       \
+    }                                                                           \
+    map->slots[i].hash = h;                                                     \
+    map->slots[i].key = key;                                                    \
+    map->slots[i].value = (ValT){0};                                            \
+    map->size++;                                                                \
+    if (inserted != NULL) *inserted = true;                                     \
+    return &map->slots[i].value;                                                \
+}                                                                               \
+                                                                                \
+static inline void insert##name(name *map, KeyT key, ValT value) {              \
+    /* inserts key or replaces its value */                                     \
+    *getOrInsert##name(map, key, NULL) = value;                                 \
+}                                                                               \
+                                                                                \
+static inline ValT *get##name##value(name *map, KeyT key) {                     \
+    /* returns the address of key's value, or NULL if it is absent */           \
+    assert(map != NULL);                                                        \
+    int i = find##name(map, key);                                               \
+    return i < 0 ? NULL : &map->slots[i].value;                                 \
+}                                                                               \
+                                                                                \
+static inline bool contains##name##key(name *map, KeyT key) {                   \
+    assert(map != NULL);                                                        \
+    return find##name(map, key) >= 0;                                           \
+}                                                                               \
+                                                                                \
+static inline bool remove##name(name *map, KeyT key, ValT *value) {             \
+    /* removes key, storing its value in *value unless value is NULL */         \
+    assert(map != NULL);                                                        \
+    int i = find##name(map, key);                                               \
+    if (i < 0) return false;                                                    \
+    if (value != NULL) *value = map->slots[i].value;                            \
+    int mask = map->capacity - 1;                                               \
+    for (int j = (i + 1) & mask; map->slots[j].hash != 0; j = (j + 1) & mask) { \
+        int home = map->slots[j].hash & mask;                                   \
+        if (((j - home) & mask) >= ((j - i) & mask)) {                          \
+            map->slots[i] = map->slots[j];                                      \
+            i = j;                                                              \
+        }                                                                       \
+    }                                                                           \
+    map->slots[i].hash = 0;                                                     \
+    map->size--;                                                                \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline int size##name(name *map) {                                       \
+    assert(map != NULL);                                                        \
+    return map->size;                                                           \
+}                                                                               \
+                                                                                \
+static inline void clear##name(name *map) {                                     \
+    assert(map != NULL);                                                        \
+    for (int i = 0; i < map->capacity; ++i) map->slots[i].hash = 0;             \
+    map->size = 0;                                                              \
+}                                                                               \
+                                                                                \
+static inline void free##name(name *map) {                                      \
+    assert(map != NULL);                                                        \
+    free(map->slots);                                                           \
+    free(map);                                                                  \
+}
+
+#endif // !__TYPEDHASHMAP_INCLUDED__